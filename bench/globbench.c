@@ -0,0 +1,136 @@
+// Wildcard expansion of task3 against glob(3) on one large directory.
+//
+// usage: globbench [-n files] [-r rounds] [dir]
+//
+// The directory (default /tmp/globbench.<pid>) gets n empty files, four names in five ending in .log.
+// Each pattern is expanded rounds times by wildcardExpand and by glob(3) (which sorts with qsort/strcoll,
+// LC_COLLATE is left at "C" so both orders agree); the match lists are compared once.
+// The files and the directory are removed at the end.
+// Prints CSV: pattern,files,matches,wildcard_ms,glob_ms
+
+#define _GNU_SOURCE
+#include "wildcard.h"
+#include "memstat.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <time.h>
+#include <sys/stat.h>
+
+static const char *const patterns[] = {"*", "*.log", "file1*7.log", "file[0-4]?[!0]*.txt", "*x*"};
+
+#define PATTERN_COUNT ((int) (sizeof(patterns) / sizeof(patterns[0])))
+
+static double nowSeconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fileName(char *name, size_t size, long i) {
+    snprintf(name, size, "file%ld.%s", (i * 7919) % 1000003, i % 5 == 0 ? "txt" : "log");
+}
+
+/* 1 when the sorted lists agree */
+static int sameMatches(const arena *a, const wildcardMatches *m, const glob_t *g) {
+    size_t i;
+
+    if (m->count != g->gl_pathc)
+        return 0;
+    for (i = 0; i < m->count; i++)
+        if (strcmp(a->data + m->offsets[i], g->gl_pathv[i]) != 0)
+            return 0;
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    long count = 200000, rounds = 5, i;
+    char default_dir[64], name[64];
+    const char *dir = default_dir;
+    int opt, p, wrong = 0, fd;
+
+    while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+        switch (opt) {
+            case 'n':
+                count = atol(optarg);
+                break;
+            case 'r':
+                rounds = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n files] [-r rounds] [dir]\n", argv[0]);
+                return 1;
+        }
+    }
+    snprintf(default_dir, sizeof(default_dir), "/tmp/globbench.%d", getpid());
+    if (optind < argc)
+        dir = argv[optind];
+
+    if (mkdir(dir, 0755) == -1 || chdir(dir) == -1) {
+        perror(dir);
+        return 1;
+    }
+
+    for (i = 0; i < count; i++) {
+        fileName(name, sizeof(name), i);
+        if ((fd = open(name, O_CREAT | O_WRONLY, 0644)) == -1) {
+            perror(name);
+            return 1;
+        }
+        close(fd);
+    }
+
+    printf("pattern,files,matches,wildcard_ms,glob_ms\n");
+
+    for (p = 0; p < PATTERN_COUNT; p++) {
+        double start, wildcard_seconds, glob_seconds;
+        wildcardMatches m = {NULL, 0, 0};
+        arena a;
+        glob_t g;
+        long r;
+
+        arenaInit(&a);
+        start = nowSeconds();
+        for (r = 0; r < rounds; r++) {
+            arenaReset(&a);
+            m.count = 0;
+            wildcardExpand(patterns[p], &a, &m);
+        }
+        wildcard_seconds = (nowSeconds() - start) / rounds;
+
+        memset(&g, 0, sizeof(g));
+        start = nowSeconds();
+        for (r = 0; r < rounds; r++) {
+            globfree(&g);
+            memset(&g, 0, sizeof(g));
+            glob(patterns[p], 0, NULL, &g);
+        }
+        glob_seconds = (nowSeconds() - start) / rounds;
+
+        if (!sameMatches(&a, &m, &g)) {
+            fprintf(stderr, "%s: %zu matches, glob(3) found %zu or a different order\n",
+                    patterns[p], m.count, g.gl_pathc);
+            wrong++;
+        }
+
+        printf("%s,%ld,%zu,%.3f,%.3f\n", patterns[p], count, m.count, wildcard_seconds * 1e3, glob_seconds * 1e3);
+        fflush(stdout);
+
+        globfree(&g);
+        arenaFree(&a);
+        memFree(m.offsets);
+    }
+
+    for (i = 0; i < count; i++) {
+        fileName(name, sizeof(name), i);
+        unlink(name);
+    }
+    if (chdir("/") == 0)
+        rmdir(dir);
+
+    return wrong > 0;
+}
@@ -0,0 +1,235 @@
+// History ring, prefix and substring indexes of task3 at a million lines.
+//
+// usage: historybench [-n lines] [-q lookups] [-s searches] [file]
+//
+// append     historyAdd into a fresh ring file (memcpy into the mapping plus incremental indexing)
+// open       historyOpen of the full file: checks every record, the index is sorted on a thread
+// first      the first historyFind, a scan of the ring while that sort runs
+// indexed    until the sort is done and lookups go through the index
+// prefix     historyFind on prefixes of appended lines and on misses, mean and worst case
+// substring  `history -n 20 text` (printHistory into memory) on pieces of appended lines and on misses
+// Lookups are checked against a scan of the appended lines still in the ring for the newest match,
+// substring searches for the last 20 matches.
+// The file (default /tmp/historybench.<pid>) is removed at the end.
+// Prints CSV: phase,lines,ops,seconds,us_per_op,max_us
+
+#define _GNU_SOURCE
+#include "history.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#define CHECKED_LOOKUPS 200
+#define SHOWN_MATCHES 20
+
+static const char *const commands[] = {
+        "git commit -m", "make -j8", "ls -l", "cat < input.txt | grep -v", "ssh build@host",
+        "vim src/module", "find . -name", "tail -f /var/log/app", "echo", "cd /home/user/project",
+};
+
+#define COMMAND_COUNT ((int) (sizeof(commands) / sizeof(commands[0])))
+
+static double nowSeconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *makeLine(long i) {
+    char *line;
+
+    if (asprintf(&line, "%s %ld.%lx", commands[i % COMMAND_COUNT], (i * 7919) % 100003, i) == -1)
+        exit(1);
+    return line;
+}
+
+/* index of the oldest line the ring kept: every line is unique, matching with its NUL finds only itself */
+static long firstKept(char **lines, long count) {
+    long lo = 0, hi = count;
+
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+
+        if (historyFind(lines[mid], strlen(lines[mid]) + 1) == NULL)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* newest kept line starting with prefix, what historyFind must return */
+static const char *scanNewest(char **lines, long first, long count, const char *prefix, size_t length) {
+    long i;
+
+    for (i = count; i-- > first;)
+        if (strncmp(lines[i], prefix, length) == 0)
+            return lines[i];
+    return NULL;
+}
+
+/* 1 when out holds the last SHOWN_MATCHES kept lines containing substring, oldest first, after their numbers */
+static int sameMatches(char **lines, long first, long count, const char *substring, const char *out) {
+    long i, shown = 0;
+    const char *line = out;
+
+    for (i = count; i-- > first && shown < SHOWN_MATCHES;)
+        if (strstr(lines[i], substring) != NULL)
+            shown++;
+
+    for (i++; i < count; i++) {
+        size_t length = strlen(lines[i]);
+
+        if (strstr(lines[i], substring) == NULL)
+            continue;
+
+        /* "%6u  text\n": numbers past 999999 take more than six columns */
+        line += strspn(line, " ");
+        line += strspn(line, "0123456789");
+        if (strncmp(line, "  ", 2) != 0 || strncmp(line + 2, lines[i], length) != 0 || line[2 + length] != '\n')
+            return 0;
+        line += 2 + length + 1;
+    }
+    return *line == 0;
+}
+
+int main(int argc, char *argv[]) {
+    long count = 1000000, lookups = 100000, searches = 1000, i, wrong = 0, first;
+    char default_path[64], **lines;
+    const char *path = default_path;
+    double start, seconds, worst = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:q:s:")) != -1) {
+        switch (opt) {
+            case 'n':
+                count = atol(optarg);
+                break;
+            case 'q':
+                lookups = atol(optarg);
+                break;
+            case 's':
+                searches = atol(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n lines] [-q lookups] [-s searches] [file]\n", argv[0]);
+                return 1;
+        }
+    }
+    snprintf(default_path, sizeof(default_path), "/tmp/historybench.%d", getpid());
+    if (optind < argc)
+        path = argv[optind];
+
+    unlink(path);
+    if (historyOpen(path) == -1)
+        return 1;
+
+    lines = malloc(count * sizeof(char *));
+    for (i = 0; i < count; i++)
+        lines[i] = makeLine(i);
+
+    printf("phase,lines,ops,seconds,us_per_op,max_us\n");
+
+    start = nowSeconds();
+    for (i = 0; i < count; i++)
+        historyAdd(lines[i]);
+    seconds = nowSeconds() - start;
+    printf("append,%ld,%ld,%.3f,%.3f,\n", count, count, seconds, seconds / count * 1e6);
+
+    historyClose();
+    start = nowSeconds();
+    if (historyOpen(path) == -1)
+        return 1;
+    seconds = nowSeconds() - start;
+    printf("open,%ld,1,%.3f,%.3f,\n", count, seconds, seconds * 1e6);
+
+    start = nowSeconds();
+    historyFind("", 0);
+    seconds = nowSeconds() - start;
+    printf("first,%ld,1,%.3f,%.3f,\n", count, seconds, seconds * 1e6);
+
+    while (!historyIndexed())
+        usleep(1000);
+    seconds = nowSeconds() - start;
+    printf("indexed,%ld,1,%.3f,%.3f,\n", count, seconds, seconds * 1e6);
+    fflush(stdout);
+
+    first = firstKept(lines, count);
+    if (first > 0)
+        fprintf(stderr, "the ring kept the last %ld lines\n", count - first);
+
+    srand(1);
+    seconds = 0;
+    for (i = 0; i < lookups; i++) {
+        const char *line = lines[rand() % count], *found;
+        char prefix[64];
+        size_t length = 1 + rand() % strlen(line);
+        double took;
+
+        /* one lookup in eight misses */
+        snprintf(prefix, sizeof(prefix), "%s%.*s", i % 8 == 0 ? "~" : "", (int) length, line);
+        length = strlen(prefix);
+
+        start = nowSeconds();
+        found = historyFind(prefix, length);
+        took = nowSeconds() - start;
+
+        seconds += took;
+        if (took > worst)
+            worst = took;
+
+        if (i < CHECKED_LOOKUPS) {
+            const char *expected = scanNewest(lines, first, count, prefix, length);
+
+            if ((found == NULL) != (expected == NULL) || (found != NULL && strcmp(found, expected) != 0))
+                wrong++;
+        }
+    }
+    printf("prefix,%ld,%ld,%.3f,%.3f,%.3f\n", count, lookups, seconds, seconds / lookups * 1e6, worst * 1e6);
+
+    seconds = worst = 0;
+    for (i = 0; i < searches; i++) {
+        const char *line = lines[first + rand() % (count - first)];
+        size_t length = strlen(line), at = rand() % length, out_size;
+        char substring[64], *out;
+        FILE *sink;
+        double took;
+
+        /* one search in eight misses, the others take 3 to 10 bytes from inside a line */
+        length = length - at < 10 ? length - at : 3 + rand() % 8;
+        snprintf(substring, sizeof(substring), "%s%.*s", i % 8 == 0 ? "~" : "", (int) length, line + at);
+        if ((sink = open_memstream(&out, &out_size)) == NULL)
+            return 1;
+
+        start = nowSeconds();
+        printHistory(sink, SHOWN_MATCHES, substring);
+        took = nowSeconds() - start;
+        fclose(sink);
+
+        seconds += took;
+        if (took > worst)
+            worst = took;
+
+        if (i < CHECKED_LOOKUPS && !sameMatches(lines, first, count, substring, out))
+            wrong++;
+        free(out);
+    }
+    if (searches > 0)
+        printf("substring,%ld,%ld,%.3f,%.3f,%.3f\n", count, searches, seconds, seconds / searches * 1e6, worst * 1e6);
+
+    historyClose();
+    unlink(path);
+
+    for (i = 0; i < count; i++)
+        free(lines[i]);
+    free(lines);
+
+    if (wrong > 0) {
+        fprintf(stderr, "%ld checked lookups or searches returned the wrong lines\n", wrong);
+        return 1;
+    }
+    return 0;
+}
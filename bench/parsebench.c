@@ -0,0 +1,162 @@
+// Parse throughput of task3's LineParser across threads.
+//
+// usage: parsebench [-n lines per thread] [-t max threads]
+//
+// context  parseCmdLinesR with one parserContext per thread, reset every RESET_EVERY lines:
+//          nothing is shared, the speedup should stay close to the thread count
+// heap     parseCmdLines + freeCmdLines from every thread: safe, but all threads share malloc and the
+//          memstat counters, which is what the context API avoids
+// Thread counts double up to -t (default: online cpus). Every thread parses the same mix of lines and
+// the argument counts are checked against a single-threaded parse.
+// Prints CSV: mode,threads,lines,seconds,Mlines_per_s,speedup
+
+#define _GNU_SOURCE
+#include "LineParser.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#define RESET_EVERY 64
+
+static const char *const lines[] = {
+        "ls -l\n",
+        "cat < input.txt | grep -v foo | sort -u | head -n 20 > out.txt\n",
+        "make -j8 all install DESTDIR=/tmp/stage PREFIX=/usr &\n",
+        "tr a-z A-Z <<< hello | wc -c\n",
+        "sort << EOF\n",
+        "find . -name *.c -newer Makefile -print | xargs grep -l TODO | tee todo.txt\n",
+};
+
+#define LINE_COUNT ((int) (sizeof(lines) / sizeof(lines[0])))
+
+typedef struct worker {
+    pthread_t thread;
+    int context;                /* 1: parseCmdLinesR, 0: parseCmdLines */
+    long iterations;
+    long checksum;
+} worker;
+
+static pthread_barrier_t start_line;
+
+static long countArguments(cmdLine *command) {
+    long count = 0;
+
+    for (; command != NULL; command = command->next)
+        count += command->argCount + (command->inputRedirect != NULL) + (command->outputRedirect != NULL);
+    return count;
+}
+
+static void *parseLines(void *arg) {
+    worker *w = arg;
+    parserContext ctx;
+    long i;
+
+    parserInit(&ctx);
+    pthread_barrier_wait(&start_line);
+
+    for (i = 0; i < w->iterations; i++) {
+        const char *line = lines[i % LINE_COUNT];
+
+        if (w->context) {
+            w->checksum += countArguments(parseCmdLinesR(&ctx, line));
+            if (i % RESET_EVERY == RESET_EVERY - 1)
+                parserReset(&ctx);
+        } else {
+            cmdLine *command = parseCmdLines(line);
+            w->checksum += countArguments(command);
+            freeCmdLines(command);
+        }
+    }
+
+    parserDestroy(&ctx);
+    return NULL;
+}
+
+static double nowSeconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Returns the seconds taken, -1 when a thread got different results */
+static double run(int context, int threads, long iterations, long expected) {
+    worker *workers = calloc(threads, sizeof(worker));
+    double start, seconds;
+    int i, ok = 1;
+
+    pthread_barrier_init(&start_line, NULL, threads + 1);
+    for (i = 0; i < threads; i++) {
+        workers[i].context = context;
+        workers[i].iterations = iterations;
+        pthread_create(&workers[i].thread, NULL, parseLines, &workers[i]);
+    }
+
+    pthread_barrier_wait(&start_line);
+    start = nowSeconds();
+    for (i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        if (workers[i].checksum != expected)
+            ok = 0;
+    }
+    seconds = nowSeconds() - start;
+
+    pthread_barrier_destroy(&start_line);
+    free(workers);
+    return ok ? seconds : -1;
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = 1000000, expected = 0, i;
+    int max_threads = (int) sysconf(_SC_NPROCESSORS_ONLN), threads, opt, context;
+    static const char *const modes[] = {"heap", "context"};
+
+    while ((opt = getopt(argc, argv, "n:t:")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = atol(optarg);
+                break;
+            case 't':
+                max_threads = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n lines per thread] [-t max threads]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (max_threads < 1)
+        max_threads = 1;
+
+    for (i = 0; i < iterations; i++) {
+        cmdLine *command = parseCmdLines(lines[i % LINE_COUNT]);
+        expected += countArguments(command);
+        freeCmdLines(command);
+    }
+
+    printf("mode,threads,lines,seconds,Mlines_per_s,speedup\n");
+
+    for (context = 1; context >= 0; context--) {
+        double single = 0;
+
+        for (threads = 1; threads <= max_threads; threads = threads * 2 > max_threads && threads < max_threads
+                                                                 ? max_threads : threads * 2) {
+            double seconds = run(context, threads, iterations, expected);
+
+            if (seconds < 0) {
+                printf("%s,%d,%ld,mismatch,,\n", modes[context], threads, iterations * threads);
+                continue;
+            }
+            if (threads == 1)
+                single = seconds;
+
+            printf("%s,%d,%ld,%.3f,%.2f,%.2f\n", modes[context], threads, iterations * threads, seconds,
+                   iterations * threads / seconds / 1e6, single > 0 ? single * threads / seconds : 0.0);
+            fflush(stdout);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,260 @@
+// Sustained throughput of N-stage chains, wired with task3's own createPipes/leftPipe/rightPipe.
+//
+// usage: pipebench [-b bytes] [-n max cat stages] [-x myShell3]
+//
+// engine   gen | cat x N | sink, parsed with parseCmdLines and launched the way launchJob does it:
+//          every stage forked before any is waited for. gen and sink are forked, not exec'ed.
+// shell    head -c bytes /dev/zero | cat x N | wc -c run by the shell given with -x (fusion off),
+//          which catches regressions of its launcher such as stages that wait for each other
+// A chain that does not finish within the timeout is killed and reported as such.
+// Prints CSV: mode,stages,bytes,seconds,GBps,context_switches,cpu_ns_per_byte
+
+#define _GNU_SOURCE
+#include "LineParser.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#ifndef SYS_close_range
+#define SYS_close_range 436
+#endif
+
+#define CHUNK (64 * 1024)
+#define TIMEOUT_S 120
+
+static volatile sig_atomic_t timed_out = 0;
+static pid_t chain_group = 0;
+
+static void onAlarm(int signo) {
+    timed_out = 1;
+    if (chain_group > 0)
+        killpg(chain_group, SIGKILL);
+}
+
+static double nowSeconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void addUsage(struct rusage *total, const struct rusage *usage) {
+    total->ru_utime.tv_sec += usage->ru_utime.tv_sec;
+    total->ru_utime.tv_usec += usage->ru_utime.tv_usec;
+    total->ru_stime.tv_sec += usage->ru_stime.tv_sec;
+    total->ru_stime.tv_usec += usage->ru_stime.tv_usec;
+    total->ru_nvcsw += usage->ru_nvcsw;
+    total->ru_nivcsw += usage->ru_nivcsw;
+}
+
+static void report(const char *mode, int stages, long long bytes, double seconds, const struct rusage *usage,
+                   int ok) {
+    double cpu = usage->ru_utime.tv_sec + usage->ru_stime.tv_sec
+                 + (usage->ru_utime.tv_usec + usage->ru_stime.tv_usec) / 1e6;
+
+    if (!ok) {
+        printf("%s,%d,%lld,%s,,,\n", mode, stages, bytes, timed_out ? "timeout" : "error");
+        fflush(stdout);
+        return;
+    }
+
+    printf("%s,%d,%lld,%.3f,%.3f,%ld,%.3f\n", mode, stages, bytes, seconds, bytes / seconds / 1e9,
+           usage->ru_nvcsw + usage->ru_nivcsw, cpu * 1e9 / bytes);
+    fflush(stdout);
+}
+
+static void generate(long long bytes) {
+    char *buffer = calloc(1, CHUNK);
+
+    while (bytes > 0) {
+        ssize_t n = write(STDOUT_FILENO, buffer, bytes < CHUNK ? bytes : CHUNK);
+        if (n <= 0)
+            _exit(EXIT_FAILURE);
+        bytes -= n;
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+static void sink(long long bytes) {
+    char *buffer = malloc(CHUNK);
+    long long total = 0;
+    ssize_t n;
+
+    while ((n = read(STDIN_FILENO, buffer, CHUNK)) > 0)
+        total += n;
+    _exit(total == bytes ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/* the chain is launched like launchJob: all stages concurrently, the parent drops each end it handed over */
+static void benchEngine(int stages, long long bytes) {
+    char line[4096] = "gen";
+    cmdLine *command, *cur;
+    struct rusage total, usage;
+    int **pipes, counter = stages + 2, i, status, ok = 1;
+    double start;
+    pid_t pid;
+
+    for (i = 0; i < stages; i++)
+        strcat(line, " | cat");
+    strcat(line, " | sink");
+    command = parseCmdLines(line);
+
+    memset(&total, 0, sizeof(total));
+    chain_group = 0;
+    start = nowSeconds();
+    alarm(TIMEOUT_S);
+
+    pipes = createPipes(counter - 1);
+    for (cur = command; cur != NULL; cur = cur->next) {
+        if ((pid = fork()) == 0) {
+            setpgid(0, chain_group);
+            if (leftPipe(pipes, cur) != NULL)
+                dup2(leftPipe(pipes, cur)[0], STDIN_FILENO);
+            if (rightPipe(pipes, cur) != NULL)
+                dup2(rightPipe(pipes, cur)[1], STDOUT_FILENO);
+
+            if (strcmp(cur->arguments[0], "gen") == 0 || strcmp(cur->arguments[0], "sink") == 0) {
+                syscall(SYS_close_range, 3, ~0U, 0);  /* no exec closes the other ends for us */
+                if (cur->arguments[0][0] == 'g')
+                    generate(bytes);
+                sink(bytes);
+            }
+            execvp(cur->arguments[0], cur->arguments);
+            _exit(127);
+        }
+
+        if (chain_group == 0)
+            chain_group = pid;
+        setpgid(pid, chain_group);
+
+        if (rightPipe(pipes, cur) != NULL)
+            close(rightPipe(pipes, cur)[1]);
+        if (leftPipe(pipes, cur) != NULL)
+            close(leftPipe(pipes, cur)[0]);
+    }
+    releasePipes(pipes, counter - 1);
+
+    for (i = 0; i < counter; i++) {
+        if (wait4(-chain_group, &status, 0, &usage) == -1) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        addUsage(&total, &usage);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            ok = 0;
+    }
+    alarm(0);
+
+    report("engine", stages, bytes, nowSeconds() - start, &total, ok && !timed_out);
+    freeCmdLines(command);
+}
+
+/* the shell's rusage covers the stages it reaped */
+static void benchShell(const char *shell, int stages, long long bytes) {
+    char script[] = "/tmp/pipebench.XXXXXX", result[4096];
+    struct rusage usage;
+    int fd, out[2], status, i;
+    long long counted = -1;
+    size_t length = 0;
+    double start;
+    ssize_t n;
+    FILE *f;
+
+    if ((fd = mkstemp(script)) == -1 || (f = fdopen(fd, "w")) == NULL) {
+        perror("pipebench: script");
+        return;
+    }
+    fprintf(f, "set fuse off\nhead -c %lld /dev/zero", bytes);
+    for (i = 0; i < stages; i++)
+        fprintf(f, " | cat");
+    fprintf(f, " | wc -c\nquit\n");
+    fclose(f);
+
+    pipe(out);
+    start = nowSeconds();
+    alarm(TIMEOUT_S);
+
+    if ((chain_group = fork()) == 0) {
+        setpgid(0, 0);
+        freopen(script, "r", stdin);
+        dup2(out[1], STDOUT_FILENO);
+        close(out[0]);
+        close(out[1]);
+        execl(shell, shell, (char *) NULL);
+        _exit(127);
+    }
+    setpgid(chain_group, chain_group);
+    close(out[1]);
+
+    while (length < sizeof(result) - 1 && (n = read(out[0], result + length, sizeof(result) - 1 - length)) != 0) {
+        if (n == -1) {
+            if (errno == EINTR && !timed_out)
+                continue;
+            break;
+        }
+        length += n;
+    }
+    result[length] = 0;
+    close(out[0]);
+
+    /* a timed out shell was killed with its whole group, the read above ended with EINTR */
+    while (wait4(chain_group, &status, 0, &usage) == -1 && errno == EINTR);
+    alarm(0);
+    unlink(script);
+
+    /* the count follows the prompt of the line that ran the chain */
+    for (i = (int) length - 1; i > 0; i--)
+        if (result[i - 1] == '>' && sscanf(result + i, "%lld", &counted) == 1)
+            break;
+
+    report("shell", stages, bytes, nowSeconds() - start, &usage, counted == bytes && !timed_out);
+}
+
+int main(int argc, char *argv[]) {
+    long long bytes = 256LL << 20;
+    int max_stages = 16, stages, opt;
+    const char *shell = NULL;
+    struct sigaction sa;
+
+    while ((opt = getopt(argc, argv, "b:n:x:")) != -1) {
+        switch (opt) {
+            case 'b':
+                bytes = atoll(optarg);
+                break;
+            case 'n':
+                max_stages = atoi(optarg);
+                break;
+            case 'x':
+                shell = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-b bytes] [-n max cat stages] [-x myShell3]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onAlarm;
+    sigaction(SIGALRM, &sa, NULL);
+
+    printf("mode,stages,bytes,seconds,GBps,context_switches,cpu_ns_per_byte\n");
+
+    for (stages = 0; stages <= max_stages; stages = stages ? stages * 2 : 1) {
+        timed_out = 0;
+        benchEngine(stages, bytes);
+        if (shell != NULL) {
+            timed_out = 0;
+            benchShell(shell, stages, bytes);
+        }
+    }
+
+    return 0;
+}
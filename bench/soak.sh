@@ -0,0 +1,78 @@
+#!/bin/sh
+# Memory soak of myShell3: feeds it a long stream of mixed lines and samples its RSS over time.
+#
+# usage: bench/soak.sh <myShell3> [lines] [sample interval seconds]
+#
+# The stream cycles through plain commands, pipelines, here-strings, $(...) substitutions and
+# background jobs, and asks for memstat every 100000 lines. A shell that returns what it allocates
+# levels off after the first samples; a line that keeps climbing is a leak.
+# Writes soak.csv (seconds,rss_kb) and soak.memstat into the current directory, plots the CSV
+# into soak.png when gnuplot is installed, and always prints a coarse text plot.
+
+SHELL_BIN=${1:?usage: $0 <myShell3> [lines] [sample interval seconds]}
+LINES=${2:-1000000}
+INTERVAL=${3:-1}
+
+awk -v n="$LINES" 'BEGIN {
+    mix[0] = "true"
+    mix[1] = "echo soak | cat > /dev/null"
+    mix[2] = "cat <<< soak > /dev/null"
+    mix[3] = "echo $(echo soak) > /dev/null"
+    mix[4] = "true &"
+    for (i = 1; i <= n; i++) {
+        print mix[i % 5]
+        if (i % 100000 == 0)
+            print "memstat"
+    }
+    print "memstat"
+    print "quit"
+}' | "$SHELL_BIN" > soak.memstat 2>&1 &
+PID=$!
+
+rss() {
+    awk '/^VmRSS:/ { print $2 }' "/proc/$PID/status" 2>/dev/null
+}
+
+echo "seconds,rss_kb" > soak.csv
+START=$(date +%s)
+while kill -0 "$PID" 2>/dev/null; do
+    kb=$(rss)
+    [ -n "$kb" ] && echo "$(($(date +%s) - START)),$kb" >> soak.csv
+    sleep "$INTERVAL"
+done
+wait "$PID"
+
+# the last memstat table; it follows a prompt on the same line
+awk '/SUBSYSTEM/ { sub(/.*SUBSYSTEM/, "SUBSYSTEM"); block = ""; on = 1 }
+     on { block = block $0 "\n" }
+     /^heap in use/ { on = 0 }
+     END { printf "%s", block }' soak.memstat
+
+if command -v gnuplot > /dev/null; then
+    gnuplot <<EOF
+set terminal png size 1000,500
+set output "soak.png"
+set datafile separator ","
+set xlabel "seconds"
+set ylabel "RSS (kB)"
+plot "soak.csv" every ::1 using 1:2 with lines title "myShell3 RSS, $LINES lines"
+EOF
+    echo "plot written to soak.png"
+fi
+
+# one row per sample bucket: time, RSS and a bar scaled between the minimum and maximum RSS
+awk -F, 'NR > 1 { t[++n] = $1; r[n] = $2; if (min == "" || $2 < min) min = $2; if ($2 > max) max = $2 }
+END {
+    if (n == 0)
+        exit
+    step = n > 30 ? n / 30 : 1
+    for (i = 1; i <= n; i += step) {
+        k = int(i)
+        bar = max > min ? int(50 * (r[k] - min) / (max - min)) : 0
+        printf "%6ds %8d kB |", t[k], r[k]
+        for (j = 0; j < bar; j++)
+            printf "#"
+        printf "\n"
+    }
+    printf "min %d kB, max %d kB, last %d kB over %d samples\n", min, max, r[n], n
+}' soak.csv
@@ -0,0 +1,283 @@
+// Spawn latency of the shell builds, driven through a pseudo-terminal so every shell flushes its prompt.
+//
+// usage: spawnbench [-n samples] label:path:stages...
+//
+// stages is the longest pipeline the build can run (myShell 1, myShell2 2, myShell3 64).
+// 0 marks a program that is not a shell (mypipeline): it is forked and waited for as a whole.
+//
+// For every shell:
+//   command     `true` from writing the line to the next prompt (commands/s)
+//   exec        from writing the line to main() of the exec'ed child (`spawnbench stamp`)
+//   pipeline    `true | true | ...` with 1..64 stages, from writing the line to the next prompt
+// Prints CSV: shell,benchmark,stages,samples,mean_us,p50_us,p99_us,per_second
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <linux/limits.h>
+#include <sys/wait.h>
+
+#define OUTPUT_SIZE 65536
+#define TIMEOUT_MS 10000
+
+static char self[PATH_MAX];
+static char prompt[PATH_MAX + 2];
+
+typedef struct shell {
+    int master;
+    pid_t pid;
+    char output[OUTPUT_SIZE];
+    size_t length;
+} shell;
+
+static long long nowNs(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int compareLongs(const void *a, const void *b) {
+    long long x = *(const long long *) a, y = *(const long long *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void report(const char *label, const char *benchmark, int stages, long long *ns, int samples) {
+    double mean = 0;
+    int i;
+
+    if (samples == 0)
+        return;
+
+    for (i = 0; i < samples; i++)
+        mean += ns[i];
+    mean /= samples;
+
+    qsort(ns, samples, sizeof(long long), compareLongs);
+    printf("%s,%s,%d,%d,%.1f,%.1f,%.1f,%.1f\n", label, benchmark, stages, samples, mean / 1e3,
+           ns[samples / 2] / 1e3, ns[samples * 99 / 100] / 1e3, 1e9 / mean);
+    fflush(stdout);
+}
+
+static int startShell(shell *sh, const char *path) {
+    sh->length = 0;
+    sh->pid = forkpty(&sh->master, NULL, NULL, NULL);
+
+    if (sh->pid == -1) {
+        perror("forkpty");
+        return -1;
+    }
+
+    if (sh->pid == 0) {
+        struct termios tio;
+
+        /* no echo of the typed lines and no \r added to the output */
+        tcgetattr(STDIN_FILENO, &tio);
+        tio.c_lflag &= ~ECHO;
+        tio.c_oflag &= ~OPOST;
+        tcsetattr(STDIN_FILENO, TCSANOW, &tio);
+
+        execl(path, path, (char *) NULL);
+        perror(path);
+        _exit(127);
+    }
+
+    return 0;
+}
+
+/* Reads the shell's output until it ends with the prompt, or with a line holding a stamp when stamp != NULL */
+static int waitFor(shell *sh, long long *stamp) {
+    struct pollfd pfd = {sh->master, POLLIN, 0};
+
+    while (1) {
+        ssize_t n;
+
+        if (stamp != NULL) {
+            char *end = memchr(sh->output, '\n', sh->length);
+            if (end != NULL) {
+                char *line = sh->output;
+                int found;
+
+                *end = 0;
+                /* a prompt may still come first on the line */
+                if (strrchr(line, '>') != NULL)
+                    line = strrchr(line, '>') + 1;
+                found = sscanf(line, "%lld", stamp) == 1;
+
+                sh->length -= end + 1 - sh->output;
+                memmove(sh->output, end + 1, sh->length);
+                if (found)
+                    return 0;
+                continue;
+            }
+        } else if (sh->length >= strlen(prompt) &&
+                   memcmp(sh->output + sh->length - strlen(prompt), prompt, strlen(prompt)) == 0) {
+            sh->length = 0;
+            return 0;
+        }
+
+        if (poll(&pfd, 1, TIMEOUT_MS) <= 0)
+            return -1;
+
+        if (sh->length == OUTPUT_SIZE)
+            sh->length = 0;     /* nothing we wait for is this long, keep the tail */
+
+        n = read(sh->master, sh->output + sh->length, OUTPUT_SIZE - sh->length);
+        if (n <= 0)
+            return -1;
+        sh->length += n;
+    }
+}
+
+static void stopShell(shell *sh) {
+    int status;
+
+    if (write(sh->master, "quit\n", 5) != 5 || poll(&(struct pollfd) {sh->master, POLLIN, 0}, 1, 1000) <= 0)
+        kill(sh->pid, SIGKILL);
+    kill(sh->pid, SIGHUP);
+    waitpid(sh->pid, &status, 0);
+    close(sh->master);
+}
+
+/* one line per sample, timed from the write to the next prompt (or the exec stamp) */
+static int runLines(shell *sh, const char *line, int samples, int exec_stamp, long long *ns) {
+    int i;
+
+    for (i = 0; i < samples; i++) {
+        long long start, stamp;
+
+        start = nowNs();
+        if (write(sh->master, line, strlen(line)) != (ssize_t) strlen(line))
+            return i;
+
+        if (exec_stamp) {
+            if (waitFor(sh, &stamp) == -1)
+                return i;
+            ns[i] = stamp - start;
+            if (waitFor(sh, NULL) == -1)
+                return i;
+        } else {
+            if (waitFor(sh, NULL) == -1)
+                return i;
+            ns[i] = nowNs() - start;
+        }
+    }
+
+    return samples;
+}
+
+static void benchShell(const char *label, const char *path, int max_stages, int samples, long long *ns) {
+    char line[PATH_MAX + sizeof(" stamp\n")];   /* the stamp line, longer than any pipeline line */
+    int stages, done, i;
+    shell *sh = malloc(sizeof(shell));
+
+    if (startShell(sh, path) == -1 || waitFor(sh, NULL) == -1) {
+        fprintf(stderr, "%s: no prompt\n", label);
+        free(sh);
+        return;
+    }
+
+    done = runLines(sh, "true\n", samples, 0, ns);
+    report(label, "command", 1, ns, done);
+
+    snprintf(line, sizeof(line), "%s stamp\n", self);
+    if (done == samples) {
+        done = runLines(sh, line, samples, 1, ns);
+        report(label, "exec", 1, ns, done);
+    }
+
+    for (stages = 1; stages <= max_stages && done > 0; stages *= 2) {
+        line[0] = 0;
+        for (i = 0; i < stages; i++)
+            strcat(line, i ? " | true" : "true");
+        strcat(line, "\n");
+
+        done = runLines(sh, line, samples / 4 + 1, 0, ns);
+        report(label, "pipeline", stages, ns, done);
+    }
+
+    if (done == 0)
+        fprintf(stderr, "%s: timed out\n", label);
+    stopShell(sh);
+    free(sh);
+}
+
+/* programs without a prompt are measured as a whole: fork, exec and wait */
+static void benchProgram(const char *label, const char *path, int samples, long long *ns) {
+    int i, status, null = open("/dev/null", O_WRONLY);
+
+    for (i = 0; i < samples; i++) {
+        long long start = nowNs();
+        pid_t pid = fork();
+
+        if (pid == 0) {
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            execl(path, path, (char *) NULL);
+            _exit(127);
+        }
+        waitpid(pid, &status, 0);
+        ns[i] = nowNs() - start;
+    }
+
+    close(null);
+    report(label, "process", 2, ns, samples);
+}
+
+int main(int argc, char *argv[]) {
+    int samples = 200, i;
+    long long *ns;
+
+    if (argc == 2 && strcmp(argv[1], "stamp") == 0) {
+        printf("%lld\n", nowNs());
+        return 0;
+    }
+
+    if (argc > 2 && strcmp(argv[1], "-n") == 0) {
+        samples = atoi(argv[2]);
+        argv += 2;
+        argc -= 2;
+    }
+
+    if (argc < 2 || samples <= 0) {
+        fprintf(stderr, "usage: %s [-n samples] label:path:stages...\n", argv[0]);
+        return 1;
+    }
+
+    if (readlink("/proc/self/exe", self, sizeof(self) - 1) == -1) {
+        perror("readlink");
+        return 1;
+    }
+    getcwd(prompt, PATH_MAX);
+    strcat(prompt, ">");
+
+    ns = malloc(samples * sizeof(long long));
+    printf("shell,benchmark,stages,samples,mean_us,p50_us,p99_us,per_second\n");
+
+    for (i = 1; i < argc; i++) {
+        char label[64], path[PATH_MAX];
+        int stages;
+
+        if (sscanf(argv[i], "%63[^:]:%4095[^:]:%d", label, path, &stages) != 3) {
+            fprintf(stderr, "bad shell spec %s\n", argv[i]);
+            continue;
+        }
+
+        if (stages == 0)
+            benchProgram(label, path, samples, ns);
+        else
+            benchShell(label, path, stages, samples, ns);
+    }
+
+    free(ns);
+    return 0;
+}
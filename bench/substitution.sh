@@ -0,0 +1,60 @@
+#!/bin/sh
+# $(...) substitution overhead of myShell3 against bash, for a small and a large captured output.
+#
+# usage: bench/substitution.sh <myShell3> [iterations] [large output bytes]
+#
+# Each case runs the same line <iterations> times from a script. The baseline case runs the
+# command without substitution, so (case - baseline) is the cost of capturing and splitting.
+# Prints CSV: shell,case,iterations,seconds,us_per_line
+
+SHELL_BIN=${1:?usage: $0 <myShell3> [iterations] [large output bytes]}
+ITERATIONS=${2:-500}
+LARGE=${3:-1048576}
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+# one long word: the line parser has no quoting, so the large case feeds a here-string
+head -c "$LARGE" /dev/zero | tr '\0' a > "$WORK/large"
+
+now() {
+    date +%s.%N
+}
+
+script() {
+    i=0
+    while [ $i -lt "$ITERATIONS" ]; do
+        echo "$1"
+        i=$((i + 1))
+    done
+}
+
+run() {
+    name=$1
+    case_name=$2
+    line=$3
+
+    script "$line" > "$WORK/script"
+    if [ "$name" = myShell3 ]; then
+        echo quit >> "$WORK/script"
+        start=$(now)
+        "$SHELL_BIN" < "$WORK/script" > /dev/null 2>&1
+    else
+        start=$(now)
+        bash "$WORK/script" > /dev/null 2>&1
+    fi
+    end=$(now)
+
+    awk -v shell="$name" -v c="$case_name" -v n="$ITERATIONS" -v start="$start" -v end="$end" 'BEGIN {
+        printf "%s,%s,%d,%.3f,%.1f\n", shell, c, n, end - start, (end - start) * 1e6 / n
+    }'
+}
+
+echo "shell,case,iterations,seconds,us_per_line"
+
+for shell in myShell3 bash; do
+    run $shell small-baseline "echo hi"
+    run $shell small "echo \$(echo hi)"
+    run $shell large-baseline "wc -c $WORK/large"
+    run $shell large "wc -c <<< \$(cat $WORK/large)"
+done
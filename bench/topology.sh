@@ -0,0 +1,69 @@
+#!/bin/sh
+# Pipeline throughput with `set topology on` against the scheduler's default placement.
+#
+# usage: bench/topology.sh <myShell3> [bytes] [stages] [runs] [background jobs]
+#
+# Pushes <bytes> from /dev/zero through <stages> cat stages into wc -c, once per mode and run,
+# optionally next to <background jobs> busy loops started from the same shell.
+# Prints CSV: mode,run,stages,background,bytes,seconds,MBps
+
+SHELL_BIN=${1:?usage: $0 <myShell3> [bytes] [stages] [runs] [background jobs]}
+BYTES=${2:-1073741824}
+STAGES=${3:-3}
+RUNS=${4:-5}
+BACKGROUND=${5:-0}
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+printf 'while :; do :; done\n' > "$WORK/spin.sh"
+
+pipeline="head -c $BYTES /dev/zero"
+i=0
+while [ $i -lt "$STAGES" ]; do
+    pipeline="$pipeline | cat"
+    i=$((i + 1))
+done
+pipeline="$pipeline | wc -c"
+
+now() {
+    date +%s.%N
+}
+
+echo "mode,run,stages,background,bytes,seconds,MBps"
+
+for mode in off on; do
+    run=1
+    while [ "$run" -le "$RUNS" ]; do
+        {
+            # fusion would fold the cat stages this measures, as in pipebench
+            echo "set fuse off"
+            echo "set topology $mode"
+            i=0
+            while [ $i -lt "$BACKGROUND" ]; do
+                echo "sh $WORK/spin.sh &"
+                i=$((i + 1))
+            done
+            echo "$pipeline"
+            echo "stop 1-4194304"
+            echo "quit"
+        } > "$WORK/script"
+
+        start=$(now)
+        "$SHELL_BIN" < "$WORK/script" > "$WORK/out" 2>&1
+        end=$(now)
+
+        if ! grep -q ">$BYTES\$" "$WORK/out"; then
+            echo "run $mode/$run did not move $BYTES bytes:" >&2
+            cat "$WORK/out" >&2
+            exit 1
+        fi
+
+        awk -v mode="$mode" -v run="$run" -v stages="$STAGES" -v bg="$BACKGROUND" -v bytes="$BYTES" \
+            -v start="$start" -v end="$end" 'BEGIN {
+                seconds = end - start
+                printf "%s,%d,%d,%d,%d,%.3f,%.1f\n", mode, run, stages, bg, bytes, seconds, bytes / seconds / 1048576
+            }'
+        run=$((run + 1))
+    done
+done
@@ -201,8 +201,6 @@ void freeProcessList(process* process_list){
 
         freeProcessList(curr->next);
         freeCmdLines(curr->cmd);
-        free(curr->cmd);
-        free(curr->next);
         free(curr);
     }
 
@@ -1,32 +1,98 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include "LineParser.h"
+#include "memstat.h"
 
 #ifndef NULL
 #define NULL 0
 #endif
 
-#define FREE(X) if(X) free((void*)X)
+#define FREE(X) if(X) memFree((void*)X)
 
-static char *cloneFirstWord(char *str)
+#define INSIDE(X, BASE, SIZE) ((const char*)(X) >= (BASE) && (const char*)(X) < (BASE) + (SIZE))
+
+/* a string of pCmdLine, unless it lives in the mapping the command was loaded from or in its argument block */
+#define FREE_STRING(C, X) if ((X) && !INSIDE(X, (C)->sharedBase, (C)->sharedSize) \
+                              && !INSIDE(X, (C)->argStrings, (C)->argStringsSize)) memFree((void*)X)
+
+/* where the cmdLines and strings of a parse come from: the heap for parseCmdLines, */
+/* the arena of the caller's context for parseCmdLinesR */
+typedef struct parseAlloc {
+    void *(*alloc)(void *owner, size_t size);
+    void (*release)(void *ptr);     /* NULL when blocks go with the arena */
+    void *owner;
+} parseAlloc;
+
+#define RELEASE(A, X) if ((X) && (A)->release) (A)->release((void*)X)
+
+static void *heapAlloc(void *owner, size_t size)
+{
+    return memAlloc(MEM_PARSER, size);
+}
+
+static const parseAlloc heap_alloc = {heapAlloc, memFree, NULL};
+
+/* bump allocation from the newest chunk, a new chunk when it is full */
+static void *contextAlloc(void *owner, size_t size)
+{
+    parserContext *ctx = (parserContext*) owner;
+    parserChunk *chunk = ctx->chunks;
+    void *block;
+
+    size = (size + 15) & ~(size_t) 15;
+
+    if (chunk == NULL || chunk->used + size > chunk->size) {
+        size_t capacity = size > PARSER_CHUNK_SIZE ? size : PARSER_CHUNK_SIZE;
+
+        chunk = (parserChunk*) memAlloc(MEM_PARSER, sizeof(parserChunk) + capacity);
+        chunk->next = ctx->chunks;
+        chunk->used = 0;
+        chunk->size = capacity;
+        ctx->chunks = chunk;
+    }
+
+    block = chunk->data + chunk->used;
+    chunk->used += size;
+    return block;
+}
+
+/* Copies length bytes of source and then suffix into one string */
+static char *strCloneN(const parseAlloc *a, const char *source, size_t length, const char *suffix)
+{
+    size_t extra = strlen(suffix);
+    char *clone = (char*) a->alloc(a->owner, length + extra + 1);
+
+    memcpy(clone, source, length);
+    memcpy(clone + length, suffix, extra + 1);
+    return clone;
+}
+
+static char *strClone(const parseAlloc *a, const char *source)
+{
+    return strCloneN(a, source, strlen(source), "");
+}
+
+/* The first word of str followed by suffix, NULL when there is none */
+static char *cloneFirstWord(const parseAlloc *a, char *str, const char *suffix)
 {
     char *start = NULL;
     char *end = NULL;
-    char *word;
 
     while (!end) {
         switch (*str) {
             case '>':
             case '<':
             case 0:
-                end = str - 1;
+                end = str;
                 break;
             case ' ':
                 if (start)
-                    end = str - 1;
+                    end = str;
                 break;
             default:
                 if (!start)
@@ -39,37 +105,44 @@ static char *cloneFirstWord(char *str)
     if (start == NULL)
         return NULL;
 
-    word = (char*) malloc(end-start+2);
-    strncpy(word, start, ((int)(end-start)+1)) ;
-    word[ (int)((end-start)+1)] = 0;
-
-    return word;
+    return strCloneN(a, start, end - start, suffix);
 }
 
-static void extractRedirections(char *strLine, cmdLine *pCmdLine)
+static void extractRedirections(const parseAlloc *a, char *strLine, cmdLine *pCmdLine)
 {
     char *s = strLine;
 
     while ( (s = strpbrk(s,"<>")) ) {
-        if (*s == '<') {
-            FREE(pCmdLine->inputRedirect);
-            pCmdLine->inputRedirect = cloneFirstWord(s+1);
+        if (s[0] == '<' && s[1] == '<' && s[2] == '<') {
+            char *word = cloneFirstWord(a, s+3, "\n");
+            RELEASE(a, pCmdLine->hereDocument);
+            pCmdLine->hereDocument = word ? word : strClone(a, "\n");
+            *s = 0;
+            s += 3;
+            continue;
+        }
+        else if (s[0] == '<' && s[1] == '<') {
+            RELEASE(a, pCmdLine->hereDelimiter);
+            RELEASE(a, pCmdLine->hereDocument);
+            pCmdLine->hereDelimiter = cloneFirstWord(a, s+2, "");
+            pCmdLine->hereDocument = NULL;
+            *s = 0;
+            s += 2;
+            continue;
+        }
+        else if (*s == '<') {
+            RELEASE(a, pCmdLine->inputRedirect);
+            pCmdLine->inputRedirect = cloneFirstWord(a, s+1, "");
         }
         else {
-            FREE(pCmdLine->outputRedirect);
-            pCmdLine->outputRedirect = cloneFirstWord(s+1);
+            RELEASE(a, pCmdLine->outputRedirect);
+            pCmdLine->outputRedirect = cloneFirstWord(a, s+1, "");
         }
 
         *s++ = 0;
     }
 }
 
-static char *strClone(const char *source)
-{
-    char* clone = (char*)malloc(strlen(source) + 1);
-    strcpy(clone, source);
-    return clone;
-}
 
 static int isEmpty(const char *str)
 {
@@ -83,32 +156,49 @@ static int isEmpty(const char *str)
   return 1;
 }
 
-static cmdLine *parseSingleCmdLine(const char *strLine)
+/* Cuts line (a writable copy owned by the caller) in place: no strtok, no state outside the call */
+static cmdLine *parseSingleCmdLine(const parseAlloc *a, char *line)
 {
-    char *delimiter = " ";
-    char *line, *result;
-    
-    if (isEmpty(strLine))
+    cmdLine *pCmdLine;
+    char *start;
+    int count;
+
+    if (isEmpty(line))
       return NULL;
     
-    cmdLine* pCmdLine = (cmdLine*)malloc( sizeof(cmdLine) ) ;
+    pCmdLine = (cmdLine*) a->alloc(a->owner, sizeof(cmdLine));
     memset(pCmdLine, 0, sizeof(cmdLine));
     
-    line = strClone(strLine);
-         
-    extractRedirections(line, pCmdLine);
-    
-    result = strtok( line, delimiter);    
-    while( result && pCmdLine->argCount < MAX_ARGUMENTS-1) {
-        ((char**)pCmdLine->arguments)[pCmdLine->argCount++] = strClone(result);
-        result = strtok ( NULL, delimiter);
+    extractRedirections(a, line, pCmdLine);
+
+    /* words are counted first, the vector is allocated at its final size */
+    for (start = line, count = 0; *start; ) {
+        while (*start == ' ')
+            start++;
+        if (*start)
+            count++;
+        while (*start && *start != ' ')
+            start++;
+    }
+    pCmdLine->arguments = (char**) a->alloc(a->owner, (count + 1) * sizeof(char*));
+
+    while (1) {
+        while (*line == ' ')
+            line++;
+        if (*line == 0)
+            break;
+
+        start = line;
+        while (*line && *line != ' ')
+            line++;
+        ((char**)pCmdLine->arguments)[pCmdLine->argCount++] = strCloneN(a, start, line - start, "");
     }
+    ((char**)pCmdLine->arguments)[pCmdLine->argCount] = NULL;
 
-    FREE(line);
     return pCmdLine;
 }
 
-static cmdLine* _parseCmdLines(char *line)
+static cmdLine* _parseCmdLines(const parseAlloc *a, char *line)
 {
 	char *nextStrCmd;
 	cmdLine *pCmdLine;
@@ -121,47 +211,156 @@ static cmdLine* _parseCmdLines(char *line)
 	if (nextStrCmd)
 	  *nextStrCmd = 0;
 	
-	pCmdLine = parseSingleCmdLine(line);
+	pCmdLine = parseSingleCmdLine(a, line);
 	if (!pCmdLine)
 	  return NULL;
 	
 	if (nextStrCmd)
-	  pCmdLine->next = _parseCmdLines(nextStrCmd+1);
+	  pCmdLine->next = _parseCmdLines(a, nextStrCmd+1);
 
 	return pCmdLine;
 }
 
-cmdLine *parseCmdLines(const char *strLine)
+/* Cuts the next pipeline of a list at its terminator: ; & && || or the end of the line */
+/* Returns where the rest of the list starts and stores the LIST_* connector and whether the pipeline blocks */
+static char *cutPipeline(char *line, char *connector, char *blocking)
 {
-	char* line, *ampersand;
-	cmdLine *head, *last;
-	int idx = 0;
-	
-	if (isEmpty(strLine))
+	char *end = strpbrk(line, ";&|");
+
+	while (end && end[0] == '|' && end[1] != '|')
+	  end = strpbrk(end + 1, ";&|");
+
+	*connector = LIST_PIPE;
+	*blocking = 1;
+	if (!end)
 	  return NULL;
+
+	if (end[0] == '&' && end[1] == '&')
+	  *connector = LIST_AND;
+	else if (end[0] == '|')
+	  *connector = LIST_OR;
+	else {
+	  *connector = LIST_SEQ;
+	  *blocking = end[0] != '&';
+	  *end = 0;
+	  return end + 1;
+	}
+
+	*end = 0;
+	return end + 2;
+}
+
+/* line is a writable, non-empty copy */
+static cmdLine *parseLine(const parseAlloc *a, char *line)
+{
+	cmdLine *head = NULL, **tail = &head, *pipeline, *last = NULL;
+	char connector, blocking;
+	int idx;
 	
-	line = strClone(strLine);
 	if (line[strlen(line)-1] == '\n')
 	  line[strlen(line)-1] = 0;
 	
-	ampersand = strchr( line,  '&');
-	if (ampersand)
-	  *(ampersand) = 0;
-		
-	if ( (last = head = _parseCmdLines(line)) )
-	{	
-	  while (last->next)
-	    last = last->next;
-	  last->blocking = ampersand? 0:1;
+	while (line) {
+	  char *rest = cutPipeline(line, &connector, &blocking);
+
+	  /* empty pipelines (;; or a trailing ;) add nothing */
+	  if ( (pipeline = _parseCmdLines(a, line)) ) {
+	    for (idx = 0, last = pipeline; ; last = last->next) {
+	      last->idx = idx++;
+	      if (!last->next)
+	        break;
+	    }
+	    last->blocking = blocking;
+	    last->connector = connector;
+	    *tail = pipeline;
+	    tail = &last->next;
+	  }
+	  line = rest;
 	}
+
+	/* nothing follows the last pipeline */
+	if (last)
+	  last->connector = LIST_PIPE;
+
+	return head;
+}
+
+cmdLine *parseCmdLines(const char *strLine)
+{
+	char *line;
+	cmdLine *head;
 	
-	for (last = head; last; last = last->next)
-		last->idx = idx++;
-			
+	if (isEmpty(strLine))
+	  return NULL;
+	
+	line = strClone(&heap_alloc, strLine);
+	head = parseLine(&heap_alloc, line);
 	FREE(line);
 	return head;
 }
 
+void parserInit(parserContext *ctx)
+{
+    ctx->chunks = NULL;
+    ctx->scratch = NULL;
+    ctx->scratchSize = 0;
+}
+
+cmdLine *parseCmdLinesR(parserContext *ctx, const char *strLine)
+{
+    parseAlloc a = {contextAlloc, NULL, ctx};
+    size_t length;
+
+    if (isEmpty(strLine))
+      return NULL;
+
+    length = strlen(strLine) + 1;
+    if (length > ctx->scratchSize) {
+        ctx->scratchSize = length * 2;
+        ctx->scratch = (char*) memRealloc(MEM_PARSER, ctx->scratch, ctx->scratchSize);
+    }
+    memcpy(ctx->scratch, strLine, length);
+
+    return parseLine(&a, ctx->scratch);
+}
+
+void parserReset(parserContext *ctx)
+{
+    parserChunk *chunk;
+
+    if (ctx->chunks == NULL)
+      return;
+
+    /* the newest chunk is kept for the next lines */
+    while ((chunk = ctx->chunks->next) != NULL) {
+        ctx->chunks->next = chunk->next;
+        memFree(chunk);
+    }
+    ctx->chunks->used = 0;
+}
+
+void parserDestroy(parserContext *ctx)
+{
+    parserReset(ctx);
+    FREE(ctx->chunks);
+    FREE(ctx->scratch);
+    parserInit(ctx);
+}
+
+
+cmdLine *splitPipeline(cmdLine *command, char *connector)
+{
+  cmdLine *rest;
+
+  while (command->next && command->connector == LIST_PIPE)
+    command = command->next;
+
+  *connector = command->connector;
+  rest = command->next;
+  command->next = NULL;
+  command->connector = LIST_PIPE;
+  return rest;
+}
 
 void freeCmdLines(cmdLine *pCmdLine)
 {
@@ -169,10 +368,15 @@ void freeCmdLines(cmdLine *pCmdLine)
   if (!pCmdLine)
     return;
 
-  FREE(pCmdLine->inputRedirect);
-  FREE(pCmdLine->outputRedirect);
+  FREE_STRING(pCmdLine, pCmdLine->inputRedirect);
+  FREE_STRING(pCmdLine, pCmdLine->outputRedirect);
+  FREE_STRING(pCmdLine, pCmdLine->hereDocument);
+  FREE_STRING(pCmdLine, pCmdLine->hereDelimiter);
+  closeInheritedFds(pCmdLine);
   for (i=0; i<pCmdLine->argCount; ++i)
-      FREE(pCmdLine->arguments[i]);
+      FREE_STRING(pCmdLine, pCmdLine->arguments[i]);
+  FREE(pCmdLine->arguments);
+  FREE(pCmdLine->argStrings);
 
   if (pCmdLine->next)
 	  freeCmdLines(pCmdLine->next);
@@ -185,29 +389,86 @@ int replaceCmdArg(cmdLine *pCmdLine, int num, const char *newString)
   if (num >= pCmdLine->argCount)
     return 0;
   
-  FREE(pCmdLine->arguments[num]);
-  ((char**)pCmdLine->arguments)[num] = strClone(newString);
+  FREE_STRING(pCmdLine, pCmdLine->arguments[num]);
+  ((char**)pCmdLine->arguments)[num] = strClone(&heap_alloc, newString);
+  return 1;
+}
+
+void setCmdArguments(cmdLine *pCmdLine, char **argv, int argc, char *strings, size_t size)
+{
+  int i;
+
+  for (i=0; i<pCmdLine->argCount; ++i)
+      FREE_STRING(pCmdLine, pCmdLine->arguments[i]);
+  FREE(pCmdLine->arguments);
+  FREE(pCmdLine->argStrings);
+
+  pCmdLine->arguments = argv;
+  pCmdLine->argCount = argc;
+  pCmdLine->argStrings = strings;
+  pCmdLine->argStringsSize = size;
+}
+
+void setHereDocument(cmdLine *pCmdLine, char *body)
+{
+  FREE_STRING(pCmdLine, pCmdLine->hereDocument);
+  pCmdLine->hereDocument = body;
+}
+
+int addInheritedFd(cmdLine *pCmdLine, int fd)
+{
+  if (pCmdLine->inheritedCount == MAX_INHERITED_FDS)
+    return 0;
+
+  pCmdLine->inheritedFds[pCmdLine->inheritedCount++] = fd;
+  return 1;
+}
+
+void closeInheritedFds(cmdLine *pCmdLine)
+{
+  int i;
+
+  for (i=0; i<pCmdLine->inheritedCount; ++i)
+      close(pCmdLine->inheritedFds[i]);
+  pCmdLine->inheritedCount = 0;
+}
+
+int removeCmdArgs(cmdLine *pCmdLine, int first, int count)
+{
+  int i;
+
+  if (first < 0 || count < 0 || first + count > pCmdLine->argCount)
+    return 0;
+
+  for (i = first; i < first + count; ++i)
+    FREE_STRING(pCmdLine, pCmdLine->arguments[i]);
+
+  for (i = first; i + count < pCmdLine->argCount; ++i)
+    ((char**)pCmdLine->arguments)[i] = pCmdLine->arguments[i + count];
+
+  pCmdLine->argCount -= count;
+  ((char**)pCmdLine->arguments)[pCmdLine->argCount] = NULL;
   return 1;
 }
 
 
 int ** createPipes(int nPipes){
     int** pipes;
-    pipes=(int**) calloc(nPipes, sizeof(int));
+    pipes=(int**) memCalloc(MEM_PARSER, nPipes, sizeof(int*));
 
     for (int i=0; i<nPipes;i++){
-        pipes[i]=(int*) calloc(2, sizeof(int));
-        pipe(pipes[i]);
+        pipes[i]=(int*) memCalloc(MEM_PARSER, 2, sizeof(int));
+        pipe2(pipes[i], O_CLOEXEC); /* dup2 clears the flag on the copy the stage keeps */
     }
     return pipes;
 
 }
 void releasePipes(int **pipes, int nPipes){
     for (int i=0; i<nPipes;i++){
-        free(pipes[i]);
+        memFree(pipes[i]);
 
     }
-    free(pipes);
+    memFree(pipes);
 }
 int *leftPipe(int **pipes, cmdLine *pCmdLine){
     if (pCmdLine->idx == 0) return NULL;
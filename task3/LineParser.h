@@ -1,29 +1,104 @@
-#define MAX_ARGUMENTS 256
+#ifndef LAB6_LINEPARSER_H
+#define LAB6_LINEPARSER_H
+
+#include <stddef.h>
+
+#define MAX_INHERITED_FDS 16
+
+/* how the next cmdLine of the chain follows a stage */
+#define LIST_PIPE 0	/* next stage of the same pipeline (also the last stage of the line) */
+#define LIST_SEQ 1	/* ; or &: the next pipeline runs in any case */
+#define LIST_AND 2	/* &&: the next pipeline runs when this one succeeded */
+#define LIST_OR 3	/* ||: the next pipeline runs when this one failed */
 
 typedef struct cmdLine
 {
-    char * const arguments[MAX_ARGUMENTS]; /* command line arguments (arg 0 is the command)*/
+    char * const *arguments;	/* command line arguments (arg 0 is the command), argCount of them and a NULL */
     int argCount;		/* number of arguments */
+    char *argStrings;		/* after setCmdArguments: the block holding every argument string, freed with the command */
+    size_t argStringsSize;	/* NULL and 0 until then */
     char const *inputRedirect;	/* input redirection path. NULL if no input redirection */
     char const *outputRedirect;	/* output redirection path. NULL if no output redirection */
-    char blocking;	/* boolean indicating blocking/non-blocking */
-    int idx;				/* index of current command in the chain of cmdLines (0 for the first) */
+    char const *hereDocument;	/* stdin contents from <<< word or a completed << here-document. NULL if none */
+    char const *hereDelimiter;	/* delimiter of a << here-document. NULL if none */
+    int inheritedFds[MAX_INHERITED_FDS];	/* shell's fds this command keeps across exec (process substitution) */
+    int inheritedCount;	/* number of inheritedFds still open in the shell */
+    const char *sharedBase;	/* strings in [sharedBase, sharedBase + sharedSize) belong to a mapping (script cache), */
+    size_t sharedSize;		/* freeCmdLines leaves them alone. NULL and 0 when every string is owned */
+    char blocking;	/* boolean indicating blocking/non-blocking (last stage of a pipeline) */
+    char connector;	/* LIST_* joining this stage to next */
+    int idx;				/* index of current command in its pipeline (0 for the first) */
     struct cmdLine *next;	/* next cmdLine in chain */
 } cmdLine;
 
 /* Parses a given string to arguments and other indicators */
 /* Returns NULL when there's nothing to parse */ 
 /* When successful, returns a pointer to cmdLine (in case of a pipe, this will be the head of a linked list) */
+/* A list (;, &&, || and & between pipelines) is one chain too, each stage's connector tells where its pipeline ends */
 cmdLine *parseCmdLines(const char *strLine);	/* Parse string line */
 
+/* Reentrant parsing: a caller-owned context holds the arena the parsed chains live in and the */
+/* scratch copy of the line being cut. Nothing else is shared, so each thread parses with its own */
+#define PARSER_CHUNK_SIZE (64 * 1024)
+
+typedef struct parserChunk
+{
+    struct parserChunk *next;	/* older chunk */
+    size_t used;		/* bytes handed out from data */
+    size_t size;		/* capacity of data */
+    char data[] __attribute__((aligned(16)));
+} parserChunk;
+
+typedef struct parserContext
+{
+    parserChunk *chunks;	/* arena, newest chunk first */
+    char *scratch;		/* writable copy of the line being cut */
+    size_t scratchSize;
+} parserContext;
+
+void parserInit(parserContext *ctx);
+
+/* Same as parseCmdLines, but the chain lives in the arena of ctx until parserReset or parserDestroy */
+/* It must not be given to freeCmdLines, replaceCmdArg, removeCmdArgs, setCmdArguments or setHereDocument */
+cmdLine *parseCmdLinesR(parserContext *ctx, const char *strLine);
+
+/* Drops every chain parsed with ctx, keeping one chunk for the next lines */
+void parserReset(parserContext *ctx);
+
+void parserDestroy(parserContext *ctx);
+
+/* Detaches the first pipeline of a list from the rest and stores the connector that joined them */
+/* Returns the rest of the list, NULL (and LIST_PIPE) when command was its last pipeline */
+cmdLine *splitPipeline(cmdLine *command, char *connector);
+
 /* Releases all allocated memory for the chain (linked list) */
 void freeCmdLines(cmdLine *pCmdLine);		/* Free parsed line */
 
+/* Completes the << redirection of pCmdLine. Takes ownership of the malloc'ed body */
+void setHereDocument(cmdLine *pCmdLine, char *body);
+
+/* Lets pCmdLine keep fd open across exec. Takes ownership of fd */
+/* Returns 0 when the command already keeps MAX_INHERITED_FDS fds, otherwise - returns 1 */
+int addInheritedFd(cmdLine *pCmdLine, int fd);
+
+/* Closes the shell's copies of the fds kept by pCmdLine (this command only, not the chain) */
+void closeInheritedFds(cmdLine *pCmdLine);
+
 /* Replaces arguments[num] with newString */
 /* Returns 0 if num is out-of-range, otherwise - returns 1 */
 int replaceCmdArg(cmdLine *pCmdLine, int num, const char *newString);
 
+/* Removes count arguments starting at arguments[first], shifting the rest down */
+/* Returns 0 if the range is out-of-range, otherwise - returns 1 */
+int removeCmdArgs(cmdLine *pCmdLine, int first, int count);
+
+/* Replaces all arguments with the argc strings of argv (argc + 1 entries, NULL last), all of them inside */
+/* [strings, strings + size). pCmdLine takes over argv and the strings block, the old arguments are freed */
+void setCmdArguments(cmdLine *pCmdLine, char **argv, int argc, char *strings, size_t size);
+
 int ** createPipes(int nPipes);
 void releasePipes(int **pipes, int nPipes);
 int *leftPipe(int **pipes, cmdLine *pCmdLine);
 int *rightPipe(int **pipes, cmdLine *pCmdLine);
+
+#endif //LAB6_LINEPARSER_H
@@ -0,0 +1,43 @@
+#include "arena.h"
+#include "memstat.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_MIN_CAPACITY 4096
+
+void arenaInit(arena *a) {
+    a->data = NULL;
+    a->used = 0;
+    a->capacity = 0;
+}
+
+void arenaReserve(arena *a, size_t n) {
+    size_t capacity = a->capacity ? a->capacity : ARENA_MIN_CAPACITY;
+
+    if (a->used + n <= a->capacity)
+        return;
+
+    while (capacity < a->used + n)
+        capacity *= 2;
+
+    a->data = memRealloc(MEM_LINES, a->data, capacity);
+    a->capacity = capacity;
+}
+
+size_t arenaAppend(arena *a, const char *bytes, size_t n) {
+    size_t offset = a->used;
+
+    arenaReserve(a, n);
+    memcpy(a->data + a->used, bytes, n);
+    a->used += n;
+    return offset;
+}
+
+void arenaReset(arena *a) {
+    a->used = 0;
+}
+
+void arenaFree(arena *a) {
+    memFree(a->data);
+    arenaInit(a);
+}
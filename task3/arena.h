@@ -0,0 +1,29 @@
+//
+// Growable byte arena: expanded command lines and captured output are built in one buffer.
+//
+
+#ifndef LAB6_ARENA_H
+#define LAB6_ARENA_H
+
+#include <stddef.h>
+
+typedef struct arena {
+    char *data;
+    size_t used;
+    size_t capacity;
+} arena;
+
+void arenaInit(arena *a);
+
+/* Makes room for at least n more bytes. Pointers into data are invalid afterwards, offsets stay */
+void arenaReserve(arena *a, size_t n);
+
+/* Appends n bytes and returns the offset they start at */
+size_t arenaAppend(arena *a, const char *bytes, size_t n);
+
+/* Forgets the contents but keeps the memory for the next line */
+void arenaReset(arena *a);
+
+void arenaFree(arena *a);
+
+#endif //LAB6_ARENA_H
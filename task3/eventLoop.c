@@ -0,0 +1,230 @@
+#define _GNU_SOURCE
+#include "eventLoop.h"
+#include "memstat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#define MAX_EVENTS 64
+
+typedef struct watch {
+    int fd;
+    eventHandler handler;
+    void *arg;
+    int timer;      /* 1 for timerfds owned by the loop */
+    int periodic;
+    int dead;       /* removed while its events may still be pending in this round or an enclosing one */
+    struct watch *nextDead;
+} watch;
+
+static int epoll_fd = -1;
+static int signal_fd = -1;
+static sigset_t shell_signals;
+static void (*signal_handler)(int signo) = NULL;
+
+static watch **watches = NULL; /* indexed by fd */
+static int watches_size = 0;
+static watch *dead_watches = NULL;
+static int round_depth = 0;     /* handlers run nested rounds (waitForJob), their callers still hold events */
+
+static void readSignals(int fd, uint32_t events, void *arg) {
+    struct signalfd_siginfo info[16];
+    ssize_t n;
+
+    while ((n = read(fd, info, sizeof(info))) > 0) {
+        int i;
+        for (i = 0; i < (int) (n / sizeof(info[0])); i++) {
+            if (signal_handler)
+                signal_handler((int) info[i].ssi_signo);
+        }
+    }
+}
+
+static int growWatches(int fd) {
+    if (fd < watches_size)
+        return 0;
+
+    int new_size = watches_size ? watches_size : 64;
+    while (new_size <= fd)
+        new_size *= 2;
+
+    watch **grown = memRealloc(MEM_EVENTS, watches, new_size * sizeof(watch *));
+    if (grown == NULL)
+        return -1;
+
+    memset(grown + watches_size, 0, (new_size - watches_size) * sizeof(watch *));
+    watches = grown;
+    watches_size = new_size;
+    return 0;
+}
+
+int loopInit(void) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) {
+        perror("epoll_create1 failed");
+        return -1;
+    }
+
+    sigemptyset(&shell_signals);
+    sigaddset(&shell_signals, SIGCHLD);
+    sigaddset(&shell_signals, SIGINT);
+    sigaddset(&shell_signals, SIGTSTP);
+
+    if (sigprocmask(SIG_BLOCK, &shell_signals, NULL) == -1) {
+        perror("sigprocmask failed");
+        return -1;
+    }
+
+    /* the shell hands the terminal to its jobs, so it must survive writing from the background */
+    signal(SIGTTOU, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+
+    signal_fd = signalfd(-1, &shell_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd == -1) {
+        perror("signalfd failed");
+        return -1;
+    }
+
+    return loopAddFd(signal_fd, EPOLLIN, readSignals, NULL);
+}
+
+int loopAddFd(int fd, uint32_t events, eventHandler handler, void *arg) {
+    struct epoll_event ev;
+
+    if (growWatches(fd) == -1)
+        return -1;
+
+    watch *w = memCalloc(MEM_EVENTS, 1, sizeof(watch));
+    if (w == NULL)
+        return -1;
+
+    w->fd = fd;
+    w->handler = handler;
+    w->arg = arg;
+
+    ev.events = events;
+    ev.data.ptr = w;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        int saved = errno;
+        memFree(w);
+        errno = saved;
+        return -1;
+    }
+
+    watches[fd] = w;
+    return 0;
+}
+
+void loopRemoveFd(int fd) {
+    if (fd < 0 || fd >= watches_size || watches[fd] == NULL)
+        return;
+
+    watch *w = watches[fd];
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    watches[fd] = NULL;
+
+    /* freed after the current round, the event array may still point at it */
+    w->dead = 1;
+    w->nextDead = dead_watches;
+    dead_watches = w;
+}
+
+int loopAddTimer(long ms, int periodic, eventHandler handler, void *arg) {
+    struct itimerspec spec;
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (tfd == -1) {
+        perror("timerfd_create failed");
+        return -1;
+    }
+
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = ms / 1000;
+    spec.it_value.tv_nsec = (ms % 1000) * 1000000L;
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+        spec.it_value.tv_nsec = 1; /* a zero value would disarm the timer */
+    if (periodic)
+        spec.it_interval = spec.it_value;
+
+    if (timerfd_settime(tfd, 0, &spec, NULL) == -1 || loopAddFd(tfd, EPOLLIN, handler, arg) == -1) {
+        perror("failed to arm timer");
+        close(tfd);
+        return -1;
+    }
+
+    watches[tfd]->timer = 1;
+    watches[tfd]->periodic = periodic;
+    return tfd;
+}
+
+void loopCancelTimer(int timer) {
+    if (timer < 0 || timer >= watches_size || watches[timer] == NULL || !watches[timer]->timer)
+        return;
+
+    loopRemoveFd(timer);
+    close(timer);
+}
+
+void loopSetSignalHandler(void (*handler)(int signo)) {
+    signal_handler = handler;
+}
+
+int loopRunOnce(int timeoutMs) {
+    struct epoll_event events[MAX_EVENTS];
+    int n, i;
+
+    n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeoutMs);
+    if (n == -1) {
+        if (errno == EINTR)
+            return 0;
+        perror("epoll_wait failed");
+        return -1;
+    }
+
+    round_depth++;
+
+    for (i = 0; i < n; i++) {
+        watch *w = events[i].data.ptr;
+
+        if (w->dead)
+            continue;
+
+        if (w->timer) {
+            uint64_t expirations;
+            if (read(w->fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+                continue;
+
+            w->handler(w->fd, events[i].events, w->arg);
+
+            if (!w->periodic && !w->dead)
+                loopCancelTimer(w->fd);
+        } else
+            w->handler(w->fd, events[i].events, w->arg);
+    }
+
+    /* only the outermost round knows no events[] points at a removed watch anymore */
+    if (--round_depth > 0)
+        return n;
+
+    while (dead_watches != NULL) {
+        watch *next = dead_watches->nextDead;
+        memFree(dead_watches);
+        dead_watches = next;
+    }
+
+    return n;
+}
+
+void loopChildReset(void) {
+    sigset_t none;
+
+    signal(SIGTTOU, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+    sigemptyset(&none);
+    sigprocmask(SIG_SETMASK, &none, NULL);
+}
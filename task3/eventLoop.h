@@ -0,0 +1,41 @@
+//
+// epoll based event loop driving the shell: stdin, signalfd, timerfds, pidfds.
+//
+
+#ifndef LAB6_EVENTLOOP_H
+#define LAB6_EVENTLOOP_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+typedef void (*eventHandler)(int fd, uint32_t events, void *arg);
+
+/* Creates the epoll instance and the signalfd for SIGCHLD/SIGINT/SIGTSTP. */
+/* The signals are blocked for the shell; children must call loopChildReset() before exec. */
+/* Returns 0 on success, -1 on failure */
+int loopInit(void);
+
+/* Registers fd for the given epoll events. Returns 0 on success, -1 on failure (errno is kept) */
+int loopAddFd(int fd, uint32_t events, eventHandler handler, void *arg);
+
+/* Unregisters fd. Does not close it */
+void loopRemoveFd(int fd);
+
+/* Arms a timerfd firing after ms milliseconds (every ms milliseconds when periodic) */
+/* Returns the timer id (its fd) or -1 */
+int loopAddTimer(long ms, int periodic, eventHandler handler, void *arg);
+
+/* Disarms and closes a timer returned by loopAddTimer */
+void loopCancelTimer(int timer);
+
+/* Handler called for every signal read from the signalfd */
+void loopSetSignalHandler(void (*handler)(int signo));
+
+/* Waits for events (timeoutMs -1 blocks forever) and dispatches them */
+/* Returns the number of dispatched events, -1 on error */
+int loopRunOnce(int timeoutMs);
+
+/* Restores the default signal state in a freshly forked child */
+void loopChildReset(void);
+
+#endif //LAB6_EVENTLOOP_H
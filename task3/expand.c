@@ -0,0 +1,421 @@
+#define _GNU_SOURCE
+#include "expand.h"
+#include "launcher.h"
+#include "trace.h"
+#include "variables.h"
+#include "wildcard.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#define CAPTURE_READ_SIZE (64 * 1024)
+
+/* parser metacharacters coming out of a substitution travel as these control bytes */
+static const char protected_chars[] = "|<>&;";
+static const char protected_codes[] = "\x1c\x1d\x1e\x1f\x1a";
+
+/* Returns the index of the ')' closing the '(' at open, -1 when unbalanced */
+static long matchParen(const char *line, long open) {
+    long i;
+    int depth = 0;
+
+    for (i = open; line[i]; i++) {
+        if (line[i] == '(')
+            depth++;
+        else if (line[i] == ')' && --depth == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+/* Word splitting in place: newlines and tabs separate words like spaces, metacharacters stay literal */
+static void splitWords(arena *a, size_t start) {
+    size_t i;
+    char *code;
+
+    for (i = start; i < a->used; i++) {
+        char c = a->data[i];
+
+        if (c == '\n' || c == '\t' || c == 0)
+            a->data[i] = ' ';
+        else if ((code = strchr(protected_chars, c)) != NULL)
+            a->data[i] = protected_codes[code - protected_chars];
+    }
+}
+
+/* captured output loses its trailing newlines before the split */
+static void splitCaptured(arena *a, size_t start) {
+    while (a->used > start && a->data[a->used - 1] == '\n')
+        a->used--;
+    splitWords(a, start);
+}
+
+static int nameChar(char c, int first) {
+    return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (!first && c >= '0' && c <= '9');
+}
+
+/* $NAME or ${NAME} */
+static int variableAt(const char *line, long i) {
+    return line[i] == '$' && (line[i + 1] == '{' || nameChar(line[i + 1], 1));
+}
+
+/* Appends the value of the variable referenced at line[i] to a, nothing when it is not set */
+/* Returns the index after the reference, -1 when ${...} is malformed */
+static long expandVariable(const char *line, long i, arena *a) {
+    int braced = line[i + 1] == '{';
+    long start = i + 1 + braced, end = start;
+    const char *value;
+
+    while (nameChar(line[end], end == start))
+        end++;
+
+    if (braced && (end == start || line[end] != '}')) {
+        end += strcspn(line + end, "}\n");
+        fprintf(stderr, "%.*s: bad substitution\n", (int) (end - i + (line[end] == '}')), line + i);
+        return -1;
+    }
+
+    if ((value = varGet(line + start, end - start)) != NULL) {
+        size_t at = a->used;
+
+        arenaAppend(a, value, strlen(value));
+        splitWords(a, at);
+    }
+    return end + braced;
+}
+
+/* Expands and parses the text of a substitution, ready for launchJob */
+/* Returns 0 with *command NULL when there is nothing to run, -1 on error */
+static int parseInner(const char *inner, cmdLine **command, int debug) {
+    arena scratch;
+    fdSubstitutions subs;
+    long offset;
+
+    *command = NULL;
+
+    arenaInit(&scratch);
+    if ((offset = expandLine(inner, &scratch, &subs, debug)) == -1) {
+        arenaFree(&scratch);
+        return -1;
+    }
+
+    *command = parseCmdLines(scratch.data + offset);
+    arenaFree(&scratch);
+    if (*command == NULL) {
+        dropSubstitutions(&subs);
+        return 0;
+    }
+
+    attachSubstitutions(*command, &subs);
+    restoreLiterals(*command);
+    expandWildcards(*command);
+    return 0;
+}
+
+static cmdLine *lastStage(cmdLine *command) {
+    while (command->next != NULL)
+        command = command->next;
+    return command;
+}
+
+/* Runs one pipeline through the launcher and appends its stdout to a */
+/* Returns its exit code, -1 on error */
+static int capturePipeline(cmdLine *command, arena *a, int debug) {
+    int capture[2];
+    job *j;
+
+    /* the shell waits for the output anyway, a trailing & is meaningless here */
+    lastStage(command)->blocking = 1;
+
+    if (pipe2(capture, O_CLOEXEC) == -1) {
+        perror("Failed to create the capture pipe...");
+        freeCmdLines(command);
+        return -1;
+    }
+    fcntl(capture[0], F_SETPIPE_SZ, CAPTURE_PIPE_SIZE);
+    TRACE(TRACE_PIPE, -1, -1, 1, "$()");
+
+    j = launchJob(command, debug, cmdCounter(command, debug), -1, capture[1]);
+    close(capture[1]);
+
+    /* read straight into the line being built, no intermediate buffer */
+    while (1) {
+        ssize_t n;
+
+        arenaReserve(a, CAPTURE_READ_SIZE);
+        n = read(capture[0], a->data + a->used, a->capacity - a->used);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        a->used += n;
+    }
+    close(capture[0]);
+
+    return j != NULL ? exitCode(waitForJob(j)) : EXIT_FAILURE;
+}
+
+/* Runs inner and appends its stdout to a. The pipelines of a list run one after the other, each one */
+/* expanded when its turn comes */
+static int captureCommand(const char *inner, arena *a, int debug) {
+    const char *text, *rest;
+    cmdLine *command;
+    size_t start = a->used, length;
+    char connector = LIST_SEQ, next;
+    int status = 0;
+
+    for (text = inner; text != NULL; text = rest) {
+        char *pipeline;
+        int parsed;
+
+        rest = nextPipeline(text, &length, &next);
+        if (strspn(text, " \t\n") >= length)     /* empty pipelines add nothing, as in parseCmdLines */
+            continue;
+
+        if (listRuns(connector, status)) {
+            pipeline = strndup(text, length);
+            parsed = parseInner(pipeline, &command, debug);
+            free(pipeline);
+
+            if (parsed == -1 || (command != NULL && (status = capturePipeline(command, a, debug)) == -1))
+                return -1;
+        }
+        connector = next;
+    }
+
+    splitCaptured(a, start);
+    return 0;
+}
+
+/* Starts inner concurrently on one end of a pipe: its stdout for <(...), its stdin for >(...) */
+/* The other end goes to subs for the consuming stage and /dev/fd/N naming it is appended to a */
+static int substituteProcess(const char *inner, char direction, arena *a, fdSubstitutions *subs, int stage, int debug) {
+    cmdLine *command, *rest;
+    char path[32], connector;
+    int ends[2], kept;
+    job *j = NULL;
+
+    if (subs->count == MAX_FD_SUBSTITUTIONS) {
+        fprintf(stderr, "too many process substitutions (max %d)\n", MAX_FD_SUBSTITUTIONS);
+        return -1;
+    }
+
+    if (parseInner(inner, &command, debug) == -1)
+        return -1;
+
+    /* the pipelines of a list would have to wait for each other, this one runs without the shell waiting */
+    if (command != NULL && (rest = splitPipeline(command, &connector)) != NULL) {
+        fprintf(stderr, "process substitution: command lists are not supported\n");
+        freeCmdLines(rest);
+        freeCmdLines(command);
+        return -1;
+    }
+
+    if (pipe2(ends, O_CLOEXEC) == -1) {
+        perror("Failed to create the substitution pipe...");
+        freeCmdLines(command);
+        return -1;
+    }
+
+    TRACE(TRACE_PIPE, -1, -1, 1, direction == '<' ? "<()" : ">()");
+
+    if (command != NULL) {
+        /* the shell does not wait for it: it ends with the data, like any other pipeline stage */
+        lastStage(command)->blocking = 0;
+        if (direction == '<')
+            j = launchJob(command, debug, cmdCounter(command, debug), -1, ends[1]);
+        else
+            j = launchJob(command, debug, cmdCounter(command, debug), ends[0], -1);
+        if (j != NULL)
+            j->substitution = 1;
+    }
+
+    if (direction == '<') {
+        close(ends[1]);
+        kept = ends[0];
+    } else {
+        close(ends[0]);
+        kept = ends[1];
+    }
+
+    subs->fds[subs->count] = kept;
+    subs->stages[subs->count] = stage;
+    subs->count++;
+
+    printDebug("Process substitution on fd", kept, debug);
+
+    snprintf(path, sizeof(path), "/dev/fd/%d", kept);
+    arenaAppend(a, path, strlen(path));
+    return 0;
+}
+
+/* <( and >( after another < or > are redirections of a parenthesised word, not substitutions */
+static int processSubstitutionAt(const char *line, long i) {
+    return (line[i] == '<' || line[i] == '>') && line[i + 1] == '('
+           && (i == 0 || (line[i - 1] != '<' && line[i - 1] != '>'));
+}
+
+int needsExpansion(const char *line) {
+    long i;
+
+    for (i = 0; line[i]; i++)
+        if ((line[i] == '$' && line[i + 1] == '(') || variableAt(line, i) || processSubstitutionAt(line, i))
+            return 1;
+    return 0;
+}
+
+/* Returns the index of the ')' ending a $(...), <(...) or >(...) starting at i, -1 when there is none */
+static long substitutionEnd(const char *line, long i) {
+    if ((line[i] == '$' && line[i + 1] == '(') || processSubstitutionAt(line, i))
+        return matchParen(line, i + 1);
+    return -1;
+}
+
+const char *nextPipeline(const char *line, size_t *length, char *connector) {
+    long i, end;
+
+    for (i = 0; line[i]; i++) {
+        if ((end = substitutionEnd(line, i)) != -1)
+            i = end;
+        else if ((line[i] == '|' && line[i + 1] != '|') || !strchr(";&|", line[i]))
+            continue;
+        else if (line[i] == line[i + 1] && line[i] != ';') {
+            *length = i;
+            *connector = line[i] == '&' ? LIST_AND : LIST_OR;
+            return line + i + 2;
+        } else {
+            *length = line[i] == '&' ? i + 1 : i;
+            *connector = LIST_SEQ;
+            return line + i + 1;
+        }
+    }
+
+    *length = i;
+    *connector = LIST_PIPE;
+    return NULL;
+}
+
+void maskSubstitutions(char *line) {
+    long i, end;
+
+    for (i = 0; line[i]; i++) {
+        if ((end = substitutionEnd(line, i)) != -1) {
+            memset(line + i, '_', end - i + 1);
+            i = end;
+        }
+    }
+}
+
+long expandLine(const char *line, arena *a, fdSubstitutions *subs, int debug) {
+    size_t result = a->used;
+    long i = 0, copied = 0;
+    int stage = 0;
+
+    subs->count = 0;
+
+    while (line[i]) {
+        int process = processSubstitutionAt(line, i);
+
+        /* stages are numbered along the whole chain, a list continues it like a pipe does */
+        if (line[i] == '|' || line[i] == '&' || line[i] == ';') {
+            stage++;
+            if (line[i] != ';' && line[i + 1] == line[i])
+                i++;
+        }
+
+        /* values are not scanned again: a $ or $( inside one stays as it is */
+        if (variableAt(line, i)) {
+            long end;
+
+            arenaAppend(a, line + copied, i - copied);
+            if ((end = expandVariable(line, i, a)) == -1)
+                break;
+
+            i = copied = end;
+            continue;
+        }
+
+        if ((line[i] == '$' && line[i + 1] == '(') || process) {
+            long end = matchParen(line, i + 1);
+            char *inner;
+            int status;
+
+            if (end == -1) {
+                fprintf(stderr, "unterminated %c(\n", line[i]);
+                break;
+            }
+
+            arenaAppend(a, line + copied, i - copied);
+
+            inner = strndup(line + i + 2, end - i - 2);
+            if (process)
+                status = substituteProcess(inner, line[i], a, subs, stage, debug);
+            else
+                status = captureCommand(inner, a, debug);
+            free(inner);
+            if (status == -1)
+                break;
+
+            i = copied = end + 1;
+            continue;
+        }
+        i++;
+    }
+
+    if (line[i]) {
+        dropSubstitutions(subs);
+        a->used = result;
+        return -1;
+    }
+
+    arenaAppend(a, line + copied, i - copied + 1);  /* with the terminating NUL */
+    return (long) result;
+}
+
+void attachSubstitutions(cmdLine *command, fdSubstitutions *subs) {
+    cmdLine *stage;
+    int i, n;
+
+    /* by position in the whole chain, as expandLine counted: idx starts again with each pipeline of a list */
+    for (i = 0; i < subs->count; i++) {
+        for (stage = command, n = 0; stage != NULL && n != subs->stages[i]; stage = stage->next, n++);
+
+        if (stage == NULL || !addInheritedFd(stage, subs->fds[i])) {
+            fprintf(stderr, "process substitution: /dev/fd/%d is not used by any command\n", subs->fds[i]);
+            close(subs->fds[i]);
+        }
+    }
+    subs->count = 0;
+}
+
+void dropSubstitutions(fdSubstitutions *subs) {
+    int i;
+
+    for (i = 0; i < subs->count; i++)
+        close(subs->fds[i]);
+    subs->count = 0;
+}
+
+static void restoreString(char *str) {
+    char *code;
+
+    for (; str != NULL && *str; str++)
+        if ((code = strchr(protected_codes, *str)) != NULL)
+            *str = protected_chars[code - protected_codes];
+}
+
+void restoreLiterals(cmdLine *command) {
+    int i;
+
+    for (; command != NULL; command = command->next) {
+        for (i = 0; i < command->argCount; i++)
+            restoreString(command->arguments[i]);
+        restoreString((char *) command->inputRedirect);
+        restoreString((char *) command->outputRedirect);
+        restoreString((char *) command->hereDocument);
+    }
+}
@@ -0,0 +1,54 @@
+//
+// Expansions done on the raw line before parseCmdLines, in one pass: $NAME and ${NAME} (see variables.h),
+// $(command) and <(command) / >(command) substitution. A list is expanded one pipeline at a time, just before
+// that pipeline runs, so it sees what the ones before it did: variables set, the directory changed, files made.
+//
+
+#ifndef LAB6_EXPAND_H
+#define LAB6_EXPAND_H
+
+#include "LineParser.h"
+#include "arena.h"
+
+/* size requested for the capture pipe of $(...), so large outputs need few wakeups */
+#define CAPTURE_PIPE_SIZE (1 << 20)
+
+#define MAX_FD_SUBSTITUTIONS 16
+
+/* pipe ends named by /dev/fd/N in the expanded line, waiting for the stage that uses them */
+typedef struct fdSubstitutions {
+    int count;
+    int fds[MAX_FD_SUBSTITUTIONS];
+    int stages[MAX_FD_SUBSTITUTIONS];   /* position of the consuming stage in the whole chain, not its idx */
+} fdSubstitutions;
+
+/* 1 when line holds a variable or substitution expandLine has to run, 0 when parsing it as is gives the same result */
+/* Has no side effects, any thread may call it */
+int needsExpansion(const char *line);
+
+/* Cuts the first pipeline off a raw list like parseCmdLines does, at a ;, &, && or || outside any $(...), */
+/* <(...) or >(...). *length covers the pipeline text, a single & included since it sends the pipeline to */
+/* the background, *connector gets the LIST_* after it */
+/* Returns where the rest of the list starts, NULL (and LIST_PIPE) when this was its last pipeline */
+const char *nextPipeline(const char *line, size_t *length, char *connector);
+
+/* Overwrites every $(...), <(...) and >(...) of line with '_', so that parsing it gives the shape of the */
+/* list and its here-documents without running anything */
+void maskSubstitutions(char *line);
+
+/* Expands line into the arena a. Substituted output and variable values are word-split in place and their */
+/* |, <, >, & characters are protected so the parser keeps them literal */
+/* <(...) and >(...) start their command at once and leave their pipe end in subs */
+/* Returns the offset of the NUL-terminated result in a->data, -1 on error (already reported) */
+long expandLine(const char *line, arena *a, fdSubstitutions *subs, int debug);
+
+/* Hands the pipe ends of subs to the stages of the parsed line, which keep them across exec */
+void attachSubstitutions(cmdLine *command, fdSubstitutions *subs);
+
+/* Closes the pipe ends of subs when the line is not run */
+void dropSubstitutions(fdSubstitutions *subs);
+
+/* Turns the characters protected by expandLine back into literals after parsing */
+void restoreLiterals(cmdLine *command);
+
+#endif //LAB6_EXPAND_H
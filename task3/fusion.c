@@ -0,0 +1,117 @@
+#include "fusion.h"
+#include "launcher.h"
+#include "memstat.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+static int isPlainCat(cmdLine *stage) {
+    return stage->argCount >= 1 && strcmp(stage->arguments[0], "cat") == 0 && stage->hereDelimiter == NULL;
+}
+
+static int hasInput(cmdLine *stage) {
+    return stage->inputRedirect != NULL || stage->hereDocument != NULL || stage->hereDelimiter != NULL;
+}
+
+/* unlinks stage from the chain, frees it and renumbers the rest */
+static cmdLine *removeStage(cmdLine *command, cmdLine *stage) {
+    cmdLine **link = &command;
+    cmdLine *cur;
+    int idx = 0;
+
+    while (*link != stage)
+        link = &(*link)->next;
+    *link = stage->next;
+
+    stage->next = NULL;
+    freeCmdLines(stage);
+
+    for (cur = command; cur != NULL; cur = cur->next)
+        cur->idx = idx++;
+
+    return command;
+}
+
+/* moves the fds of a <(...) named in the arguments of from to its new reader */
+static int moveInheritedFds(cmdLine *from, cmdLine *to) {
+    int i;
+
+    if (to->inheritedCount + from->inheritedCount > MAX_INHERITED_FDS)
+        return 0;
+
+    for (i = 0; i < from->inheritedCount; i++)
+        addInheritedFd(to, from->inheritedFds[i]);
+    from->inheritedCount = 0;
+    return 1;
+}
+
+/* `cat [file] | cmd` becomes `cmd < file`: the stage feeding the pipe hands its input to the reader */
+static int fuseLeadingCat(cmdLine *cat, int first, int debug) {
+    cmdLine *next = cat->next;
+    char message[256];
+
+    if (next == NULL || cat->outputRedirect != NULL || hasInput(next))
+        return 0;
+
+    if (cat->argCount == 2 && cat->arguments[1][0] != '-' && first && !hasInput(cat)) {
+        if (!moveInheritedFds(cat, next))
+            return 0;
+        snprintf(message, sizeof(message), "fuse: cat %s | %s -> %s < %s",
+                 cat->arguments[1], next->arguments[0], next->arguments[0], cat->arguments[1]);
+        next->inputRedirect = memStrdup(MEM_PARSER, cat->arguments[1]);
+    } else if (cat->argCount == 1 && cat->inheritedCount == 0 && (first || !hasInput(cat))) {
+        const char *source = cat->hereDocument ? " <<< here-document" : cat->inputRedirect ? " < " : "";
+        const char *path = cat->hereDocument || !cat->inputRedirect ? "" : cat->inputRedirect;
+
+        snprintf(message, sizeof(message), "fuse: cat%s%s | %s -> %s%s%s", source, path,
+                 next->arguments[0], next->arguments[0], source, path);
+        next->inputRedirect = cat->inputRedirect;
+        next->hereDocument = cat->hereDocument;
+        cat->inputRedirect = NULL;
+        cat->hereDocument = NULL;
+    } else
+        return 0;
+
+    printDebug(message, -1, debug);
+    return 1;
+}
+
+/* `cmd | cat > file` becomes `cmd > file` */
+static int fuseTrailingCat(cmdLine *prev, cmdLine *cat, int debug) {
+    char message[256];
+
+    if (cat->next != NULL || cat->argCount != 1 || cat->outputRedirect == NULL || hasInput(cat)
+        || cat->inheritedCount != 0 || prev->argCount == 0 || prev->outputRedirect != NULL)
+        return 0;
+
+    snprintf(message, sizeof(message), "fuse: %s | cat > %s -> %s > %s",
+             prev->arguments[0], cat->outputRedirect, prev->arguments[0], cat->outputRedirect);
+    printDebug(message, -1, debug);
+
+    prev->outputRedirect = cat->outputRedirect;
+    prev->blocking = cat->blocking;
+    cat->outputRedirect = NULL;
+    return 1;
+}
+
+cmdLine *fusePipeline(cmdLine *command, int debug) {
+    cmdLine *stage, *prev;
+    int fused = 1;
+
+    while (fused && command->next != NULL) {
+        fused = 0;
+
+        for (prev = NULL, stage = command; stage != NULL; prev = stage, stage = stage->next) {
+            if (!isPlainCat(stage) || (stage->next != NULL && stage->next->argCount == 0))
+                continue;
+
+            if (fuseLeadingCat(stage, prev == NULL, debug) || (prev != NULL && fuseTrailingCat(prev, stage, debug))) {
+                command = removeStage(command, stage);
+                fused = 1;
+                break;
+            }
+        }
+    }
+
+    return command;
+}
@@ -0,0 +1,15 @@
+//
+// Pipeline fusion: stages that only copy bytes (a plain cat) are folded into redirections of their neighbour.
+//
+
+#ifndef LAB6_FUSION_H
+#define LAB6_FUSION_H
+
+#include "LineParser.h"
+
+/* Rewrites `cat file | cmd` into `cmd < file`, drops plain `| cat |` stages and */
+/* turns `cmd | cat > file` into `cmd > file`. Each rewrite is shown with printDebug */
+/* Returns the new head of the chain (the old one may have been freed) */
+cmdLine *fusePipeline(cmdLine *command, int debug);
+
+#endif //LAB6_FUSION_H
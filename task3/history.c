@@ -0,0 +1,527 @@
+#define _GNU_SOURCE
+#include "history.h"
+#include "memstat.h"
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#define HEADER_BYTES 4096
+#define FILE_SIZE (HEADER_BYTES + HISTORY_SIZE)
+#define BLOCKS (HISTORY_SIZE / HISTORY_BLOCK)
+#define BLOCK_WORDS (HISTORY_TRIGRAMS / 64)
+#define QUERY_TRIGRAMS 64                   /* a longer text is looked up by its first ones, strstr checks the rest */
+
+static int history_fd = -1;
+static char *mapping = NULL;
+static historyHeader *header = NULL;
+static char *records = NULL;
+
+/* Index: offsets of the merged lines sorted by text, a max tree over them (newest position per node), */
+/* and the lines appended since, in append order. All of them are newer than any merged line */
+static uint64_t *sorted = NULL;
+static uint32_t *newest = NULL;
+static size_t sorted_count = 0;
+static uint64_t recent[HISTORY_RECENT];
+static size_t recent_count = 0;
+static uint64_t indexed_end = 0;    /* every record below it is in sorted or recent */
+static uint64_t merged_end = 0;     /* end when sorted was made: its texts are intact until end passes it by HISTORY_SLACK */
+
+/* Substring index: for each block of the ring, a bitmap of the trigram buckets in the records starting there. */
+/* A block is cleared when the ring comes back to it, its old records are all evicted by then (HISTORY_SLACK) */
+static uint64_t *trigram_blocks = NULL;     /* BLOCKS bitmaps of BLOCK_WORDS */
+static uint64_t block_number[BLOCKS];       /* virtual block (offset / HISTORY_BLOCK) a column holds, UINT64_MAX when none */
+static uint64_t block_first[BLOCKS];        /* offset of the first record indexed in it */
+
+/* the first sort runs on a thread so the prompt does not wait for it, the index is its own until joined */
+static pthread_t builder;
+static int building = 0;
+
+static historyRecord *recordAt(uint64_t offset) {
+    return (historyRecord *) (records + offset % HISTORY_SIZE);
+}
+
+static uint64_t recordSpace(uint32_t length) {
+    return (sizeof(historyRecord) + length + 7) & ~(uint64_t) 7;
+}
+
+static uint64_t nextRecord(uint64_t offset) {
+    historyRecord *r = recordAt(offset);
+
+    if (r->length == HISTORY_SKIP)
+        return offset + HISTORY_SIZE - offset % HISTORY_SIZE;
+    return offset + recordSpace(r->length);
+}
+
+int historyPath(char *path, size_t size) {
+    const char *home = getenv("HOME");
+
+    if (home == NULL || *home == 0)
+        return -1;
+
+    snprintf(path, size, "%s/.myshell3_history", home);
+    return 0;
+}
+
+/* ----- Index ----- */
+static int compareOffsets(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    int order = strcmp(recordAt(x)->text, recordAt(y)->text);
+
+    if (order != 0)
+        return order;
+    return x < y ? -1 : x > y;
+}
+
+static uint32_t newer(uint32_t a, uint32_t b) {
+    return sorted[a] > sorted[b] ? a : b;
+}
+
+/* bottom-up max tree: leaves at [n, 2n), any n works for a commutative operation */
+static void buildTree(void) {
+    size_t i;
+
+    memFree(newest);
+    newest = memAlloc(MEM_HISTORY, (2 * sorted_count + 1) * sizeof(uint32_t));
+    for (i = 0; i < sorted_count; i++)
+        newest[sorted_count + i] = (uint32_t) i;
+    for (i = sorted_count; i-- > 1;)
+        newest[i] = newer(newest[2 * i], newest[2 * i + 1]);
+}
+
+/* position of the newest line in sorted[lo, hi), lo < hi */
+static uint32_t newestIn(size_t lo, size_t hi) {
+    uint32_t best = (uint32_t) lo;
+
+    for (lo += sorted_count, hi += sorted_count; lo < hi; lo >>= 1, hi >>= 1) {
+        if (lo & 1)
+            best = newer(best, newest[lo++]);
+        if (hi & 1)
+            best = newer(best, newest[--hi]);
+    }
+    return best;
+}
+
+static uint32_t trigramBucket(const char *text) {
+    uint32_t trigram = (unsigned char) text[0] << 16 | (unsigned char) text[1] << 8 | (unsigned char) text[2];
+
+    return (trigram * 2654435761u) >> 16 & (HISTORY_TRIGRAMS - 1);
+}
+
+static void indexTrigrams(uint64_t offset) {
+    historyRecord *r = recordAt(offset);
+    uint64_t block = offset / HISTORY_BLOCK, *bits = trigram_blocks + block % BLOCKS * BLOCK_WORDS;
+    uint32_t bucket;
+    size_t i;
+
+    if (block_number[block % BLOCKS] != block) {
+        memset(bits, 0, BLOCK_WORDS * sizeof(uint64_t));
+        block_number[block % BLOCKS] = block;
+        block_first[block % BLOCKS] = offset;
+    }
+
+    for (i = 0; i + 3 < r->length; i++) {
+        bucket = trigramBucket(r->text + i);
+        bits[bucket / 64] |= 1ULL << bucket % 64;
+    }
+}
+
+static void rebuildIndex(void) {
+    uint64_t end = __atomic_load_n(&header->end, __ATOMIC_ACQUIRE), offset;
+    size_t capacity = 0;
+
+    memset(block_number, 0xff, sizeof(block_number));
+
+    sorted_count = recent_count = 0;
+    for (offset = __atomic_load_n(&header->start, __ATOMIC_ACQUIRE); offset < end; offset = nextRecord(offset)) {
+        if (recordAt(offset)->length == HISTORY_SKIP)
+            continue;
+        indexTrigrams(offset);
+        if (sorted_count == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            sorted = memRealloc(MEM_HISTORY, sorted, capacity * sizeof(uint64_t));
+        }
+        sorted[sorted_count++] = offset;
+    }
+
+    qsort(sorted, sorted_count, sizeof(uint64_t), compareOffsets);
+    buildTree();
+    indexed_end = merged_end = end;
+}
+
+static void *buildIndex(void *arg) {
+    rebuildIndex();
+    return NULL;
+}
+
+static void waitIndex(void) {
+    if (building) {
+        pthread_join(builder, NULL);
+        building = 0;
+    }
+}
+
+/* 1 once the first sort is done: until then lookups scan the ring rather than wait for it */
+static int indexReady(void) {
+    if (building && pthread_tryjoin_np(builder, NULL) == 0)
+        building = 0;
+    return !building;
+}
+
+/* first position in sorted[lo, sorted_count) after offset's text */
+static size_t insertionPoint(uint64_t offset, size_t lo) {
+    size_t hi = sorted_count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (compareOffsets(&sorted[mid], &offset) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* copies sorted[from, to) into merged at n, dropping the evicted lines. Returns the new n */
+static size_t copyLive(uint64_t *merged, size_t n, size_t from, size_t to, uint64_t start) {
+    for (; from < to; from++)
+        if (sorted[from] >= start)
+            merged[n++] = sorted[from];
+    return n;
+}
+
+/* sorts the recent lines into sorted, dropping the evicted ones */
+/* only the recent lines are searched, the runs of sorted between them are copied without reading their texts */
+static void mergeRecent(void) {
+    uint64_t start = __atomic_load_n(&header->start, __ATOMIC_ACQUIRE);
+    uint64_t *merged = memAlloc(MEM_HISTORY, (sorted_count + recent_count + 1) * sizeof(uint64_t));
+    size_t i = 0, j, n = 0;
+
+    qsort(recent, recent_count, sizeof(uint64_t), compareOffsets);
+
+    for (j = 0; j < recent_count; j++) {
+        size_t at = insertionPoint(recent[j], i);
+
+        n = copyLive(merged, n, i, at, start);
+        i = at;
+        if (recent[j] >= start)
+            merged[n++] = recent[j];
+    }
+    n = copyLive(merged, n, i, sorted_count, start);
+
+    memFree(sorted);
+    sorted = merged;
+    sorted_count = n;
+    recent_count = 0;
+    buildTree();
+    merged_end = indexed_end;
+}
+
+/* picks up the lines appended since the last call, by this shell or another one */
+static void catchUp(void) {
+    uint64_t end = __atomic_load_n(&header->end, __ATOMIC_ACQUIRE);
+
+    /* lines were evicted before they were indexed, or sorted may point at overwritten texts */
+    if (__atomic_load_n(&header->start, __ATOMIC_ACQUIRE) > indexed_end || end - merged_end >= HISTORY_SLACK) {
+        rebuildIndex();
+        return;
+    }
+
+    while (indexed_end < end) {
+        if (recordAt(indexed_end)->length != HISTORY_SKIP) {
+            if (recent_count == HISTORY_RECENT)
+                mergeRecent();
+            recent[recent_count++] = indexed_end;
+            indexTrigrams(indexed_end);
+        }
+        indexed_end = nextRecord(indexed_end);
+    }
+
+    if (end - merged_end >= HISTORY_SLACK / 2)
+        mergeRecent();
+}
+
+/* first position whose text compares above the prefix (upper) or not below it */
+static size_t boundary(const char *prefix, size_t length, int upper) {
+    size_t lo = 0, hi = sorted_count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int order = strncmp(recordAt(sorted[mid])->text, prefix, length);
+
+        if (order < 0 || (upper && order == 0))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+int historyIndexed(void) {
+    return header != NULL && indexReady();
+}
+
+/* the newest match by walking the whole ring, while the index is still being sorted */
+static const char *scanNewest(const char *prefix, size_t length) {
+    uint64_t end = __atomic_load_n(&header->end, __ATOMIC_ACQUIRE), offset;
+    const char *found = NULL;
+
+    for (offset = __atomic_load_n(&header->start, __ATOMIC_ACQUIRE); offset < end; offset = nextRecord(offset))
+        if (recordAt(offset)->length != HISTORY_SKIP && strncmp(recordAt(offset)->text, prefix, length) == 0)
+            found = recordAt(offset)->text;
+    return found;
+}
+
+const char *historyFind(const char *prefix, size_t length) {
+    size_t i, lo, hi;
+    uint64_t best;
+
+    if (header == NULL)
+        return NULL;
+
+    if (!indexReady())
+        return scanNewest(prefix, length);
+    catchUp();
+
+    for (i = recent_count; i-- > 0;)
+        if (strncmp(recordAt(recent[i])->text, prefix, length) == 0)
+            return recordAt(recent[i])->text;
+
+    lo = boundary(prefix, length, 0);
+    hi = boundary(prefix, length, 1);
+    if (lo == hi)
+        return NULL;
+
+    /* the newest match evicted means every match was */
+    best = sorted[newestIn(lo, hi)];
+    if (best < __atomic_load_n(&header->start, __ATOMIC_ACQUIRE))
+        return NULL;
+    return recordAt(best)->text;
+}
+
+/* ----- File ----- */
+static void resetHeader(void) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, HISTORY_MAGIC, sizeof(header->magic));
+    header->size = HISTORY_SIZE;
+    header->number = 1;
+}
+
+/* keeps the records up to the first damaged one, a torn append never published its end anyway */
+static void repair(void) {
+    uint64_t offset, next;
+
+    if (memcmp(header->magic, HISTORY_MAGIC, sizeof(header->magic)) != 0 || header->size != HISTORY_SIZE
+        || header->start % 8 != 0 || header->start > header->end || header->end - header->start > HISTORY_SIZE) {
+        resetHeader();
+        return;
+    }
+
+    for (offset = header->start; offset < header->end; offset = next) {
+        historyRecord *r = recordAt(offset);
+        uint64_t position = offset % HISTORY_SIZE;
+
+        if (r->length == HISTORY_SKIP ? position == 0
+                                      : r->length == 0 || position + recordSpace(r->length) > HISTORY_SIZE
+                                        || r->text[r->length - 1] != 0)
+            break;
+        if ((next = nextRecord(offset)) > header->end)
+            break;
+    }
+
+    header->end = offset;
+}
+
+int historyOpen(const char *path) {
+    struct stat st;
+    int fd;
+
+    if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600)) == -1)
+        return -1;
+
+    flock(fd, LOCK_EX);
+
+    /* a file of another size is from another format, it starts over */
+    if (fstat(fd, &st) == -1 || (st.st_size != FILE_SIZE && (ftruncate(fd, 0) == -1 || ftruncate(fd, FILE_SIZE) == -1))
+        || (mapping = mmap(NULL, FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        perror(path);
+        mapping = NULL;
+        close(fd);
+        return -1;
+    }
+
+    header = (historyHeader *) mapping;
+    records = mapping + HEADER_BYTES;
+    repair();
+
+    flock(fd, LOCK_UN);
+    history_fd = fd;
+
+    trigram_blocks = memAlloc(MEM_HISTORY, BLOCKS * BLOCK_WORDS * sizeof(uint64_t));
+
+    if (pthread_create(&builder, NULL, buildIndex, NULL) == 0)
+        building = 1;
+    else
+        rebuildIndex();
+    return 0;
+}
+
+void historyAdd(const char *line) {
+    size_t length = strlen(line), i;
+    uint64_t start, end, need;
+    historyRecord *r;
+
+    if (header == NULL)
+        return;
+
+    while (length > 0 && line[length - 1] == '\n')
+        length--;
+    for (i = 0; i < length && isspace((unsigned char) line[i]); i++);
+    if (i == length || (need = recordSpace(length + 1)) > HISTORY_SLACK)
+        return;
+
+    /* other shells append to the same ring */
+    flock(history_fd, LOCK_EX);
+
+    start = header->start;
+    end = header->end;
+
+    if (end % HISTORY_SIZE + need > HISTORY_SIZE) {
+        recordAt(end)->length = HISTORY_SKIP;
+        end += HISTORY_SIZE - end % HISTORY_SIZE;
+    }
+
+    /* the oldest lines go, their bytes are only reused HISTORY_SLACK later */
+    while (end + need - start > HISTORY_SIZE - HISTORY_SLACK)
+        start = nextRecord(start);
+    __atomic_store_n(&header->start, start, __ATOMIC_RELEASE);
+
+    r = recordAt(end);
+    r->length = (uint32_t) length + 1;
+    r->number = header->number++;
+    memcpy(r->text, line, length);
+    r->text[length] = 0;
+
+    /* readers only look below end: the record is complete before it is published */
+    __atomic_store_n(&header->end, end + need, __ATOMIC_RELEASE);
+
+    flock(history_fd, LOCK_UN);
+
+    /* indexing as we go keeps lookups from ever finding evicted, unindexed lines */
+    if (!building)
+        catchUp();
+}
+
+/* 1 when the records starting in the block may hold each of the count trigram buckets */
+static int candidateBlock(uint64_t block, const uint32_t *buckets, size_t count) {
+    const uint64_t *bits = trigram_blocks + block % BLOCKS * BLOCK_WORDS;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+        if (!(bits[buckets[i] / 64] & 1ULL << buckets[i] % 64))
+            return 0;
+    return 1;
+}
+
+/* appends offset to *matches when its record holds substring. Returns the new count */
+static size_t addMatch(uint64_t offset, const char *substring, uint64_t **matches, size_t count, size_t *capacity) {
+    historyRecord *r = recordAt(offset);
+
+    if (r->length == HISTORY_SKIP || (substring != NULL && strstr(r->text, substring) == NULL))
+        return count;
+    if (count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 256;
+        *matches = memRealloc(MEM_HISTORY, *matches, *capacity * sizeof(uint64_t));
+    }
+    (*matches)[count] = offset;
+    return count + 1;
+}
+
+static void reverseOffsets(uint64_t *offsets, size_t count) {
+    size_t i;
+
+    for (i = 0; i < count / 2; i++) {
+        uint64_t swapped = offsets[i];
+        offsets[i] = offsets[count - 1 - i];
+        offsets[count - 1 - i] = swapped;
+    }
+}
+
+/* Offsets of the records holding substring (NULL for all), newest first, into *matches. Returns their count */
+/* The index reads only the blocks having each trigram of substring, newest first, until it has limit of them */
+/* (0 for no limit). While it is being sorted the whole ring is scanned */
+static size_t findMatches(const char *substring, size_t limit, uint64_t **matches) {
+    size_t length = substring != NULL ? strlen(substring) : 0, count = 0, capacity = 0, queried = 0, from;
+    uint64_t start, offset, block, stop;
+    uint32_t buckets[QUERY_TRIGRAMS];
+
+    if (!indexReady()) {
+        uint64_t end = __atomic_load_n(&header->end, __ATOMIC_ACQUIRE);
+
+        for (offset = __atomic_load_n(&header->start, __ATOMIC_ACQUIRE); offset < end; offset = nextRecord(offset))
+            count = addMatch(offset, substring, matches, count, &capacity);
+        reverseOffsets(*matches, count);
+        return count;
+    }
+
+    catchUp();
+    start = __atomic_load_n(&header->start, __ATOMIC_ACQUIRE);
+
+    for (; queried < QUERY_TRIGRAMS && queried + 3 <= length; queried++)
+        buckets[queried] = trigramBucket(substring + queried);
+
+    for (block = indexed_end / HISTORY_BLOCK + 1; block-- > start / HISTORY_BLOCK && (limit == 0 || count < limit);) {
+        if (block_number[block % BLOCKS] != block || !candidateBlock(block, buckets, queried))
+            continue;
+
+        /* the records starting in the block, oldest first, then turned around */
+        from = count;
+        offset = block_first[block % BLOCKS] > start ? block_first[block % BLOCKS] : start;
+        stop = (block + 1) * HISTORY_BLOCK < indexed_end ? (block + 1) * HISTORY_BLOCK : indexed_end;
+        for (; offset < stop; offset = nextRecord(offset))
+            count = addMatch(offset, substring, matches, count, &capacity);
+        reverseOffsets(*matches + from, count - from);
+    }
+    return count;
+}
+
+void printHistory(FILE *out, long count, const char *substring) {
+    uint64_t *matches = NULL;
+    size_t found, i;
+
+    if (header == NULL) {
+        fprintf(stderr, "history: no history file\n");
+        return;
+    }
+
+    found = findMatches(substring, count > 0 ? (size_t) count : 0, &matches);
+    for (i = count > 0 && (size_t) count < found ? (size_t) count : found; i-- > 0;)
+        fprintf(out, "%6u  %s\n", recordAt(matches[i])->number, recordAt(matches[i])->text);
+    memFree(matches);
+}
+
+void historyClose(void) {
+    if (header == NULL)
+        return;
+
+    waitIndex();
+    munmap(mapping, FILE_SIZE);
+    close(history_fd);
+    mapping = records = NULL;
+    header = NULL;
+    history_fd = -1;
+
+    memFree(sorted);
+    memFree(newest);
+    memFree(trigram_blocks);
+    sorted = NULL;
+    newest = NULL;
+    trigram_blocks = NULL;
+    sorted_count = recent_count = 0;
+}
@@ -0,0 +1,64 @@
+//
+// Command history: typed lines go into a fixed-size ring file mapped MAP_SHARED, so an append is a memcpy
+// and a line is kept as soon as it is written (the page cache outlives a crash of the shell, no fsync).
+// An in-memory index sorted by text answers `!prefix` with two binary searches and a range maximum.
+// Substring search (`history text`) goes through a trigram index: per trigram bucket, a bitmap of the
+// HISTORY_BLOCK blocks of the ring holding it, only the blocks having every trigram of the text are read.
+//
+// File layout: historyHeader padded to a page, then HISTORY_SIZE bytes of 8-aligned historyRecords.
+// Offsets grow forever ("virtual"), a record lives at offset % HISTORY_SIZE and never straddles the wrap.
+//
+
+#ifndef LAB6_HISTORY_H
+#define LAB6_HISTORY_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define HISTORY_MAGIC "myshh\0\0\1"
+#define HISTORY_SIZE (64L << 20)            /* about a million lines, the file is sparse until used */
+#define HISTORY_SLACK (HISTORY_SIZE / 8)    /* evicted records stay intact for this many more bytes */
+#define HISTORY_RECENT 4096                 /* lines appended before they are merged into the sorted index */
+#define HISTORY_SKIP UINT32_MAX             /* record length filling the tail of the area before the wrap */
+#define HISTORY_BLOCK (32L << 10)           /* substring index granularity: 2048 blocks, a multiple of 64 */
+#define HISTORY_TRIGRAMS (1 << 16)          /* trigram buckets, a bitmap of every block each: 16 MiB */
+
+typedef struct historyHeader {
+    char magic[8];
+    uint64_t size;          /* HISTORY_SIZE when the file was made */
+    uint64_t start;         /* offset of the oldest record */
+    uint64_t end;           /* offset after the newest record, published last */
+    uint32_t number;        /* number of the next record */
+} historyHeader;
+
+typedef struct historyRecord {
+    uint32_t length;        /* bytes of text with its NUL, or HISTORY_SKIP */
+    uint32_t number;        /* shown by the history builtin */
+    char text[];
+} historyRecord;
+
+/* Maps the history file at path, creating it when missing or unusable */
+/* The index is sorted on a thread, lookups scan the ring until it is done. Call after the signals are blocked */
+/* Returns 0 on success, -1 when there is no history (the shell runs without one) */
+int historyOpen(const char *path);
+
+/* Default file: $HOME/.myshell3_history. Returns 0 on success, -1 when HOME is not set */
+int historyPath(char *path, size_t size);
+
+/* Appends a line (a trailing newline is dropped, blank lines are ignored). Safe with other shells on the same file */
+void historyAdd(const char *line);
+
+/* Newest line starting with the length bytes of prefix, "" matches the newest line */
+/* Returns a pointer into the mapping, valid until the next historyAdd, NULL when none */
+const char *historyFind(const char *prefix, size_t length);
+
+/* 1 once the first sort is done and lookups go through the index, 0 while they scan the ring */
+int historyIndexed(void);
+
+/* Prints the last count lines containing substring (NULL for every line) with their numbers, oldest first */
+/* count <= 0 prints all of them */
+void printHistory(FILE *out, long count, const char *substring);
+
+void historyClose(void);
+
+#endif //LAB6_HISTORY_H
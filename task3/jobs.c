@@ -0,0 +1,682 @@
+#define _GNU_SOURCE
+#include "jobs.h"
+#include "eventLoop.h"
+#include "topology.h"
+#include "trace.h"
+#include "stats.h"
+#include "options.h"
+#include "memstat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+job *global_job_list = NULL;
+
+char *getStatus(int status) {
+
+    if (status == TERMINATED)
+        return "Terminated";
+
+    else if (status == RUNNING)
+        return "Running";
+
+    else
+        return "Suspended";
+}
+
+static void printJobCommand(FILE *out, job *j) {
+    cmdLine *stage;
+    int i;
+
+    for (stage = j->cmd; stage != NULL; stage = stage->next) {
+        for (i = 0; i < stage->argCount; i++)
+            fprintf(out, i ? " %s" : "%s", stage->arguments[i]);
+        if (stage->next)
+            fprintf(out, " | ");
+    }
+    if (j->cmd && !j->cmd->blocking)
+        fprintf(out, " &");
+}
+
+/* ------- List manage -------------- */
+job *addJob(cmdLine *cmd, int background) {
+    job *new_job = memCalloc(MEM_JOBS, 1, sizeof(job));
+    job *curr = global_job_list;
+    int id = 1;
+
+    while (curr != NULL) {
+        if (curr->id >= id)
+            id = curr->id + 1;
+        if (curr->next == NULL)
+            break;
+        curr = curr->next;
+    }
+
+    new_job->id = id;
+    new_job->cmd = cmd;
+    new_job->background = background;
+    new_job->notified = RUNNING;
+
+    if (curr == NULL)
+        global_job_list = new_job;
+    else
+        curr->next = new_job;
+
+    return new_job;
+}
+
+static void pidfdReady(int fd, uint32_t events, void *arg) {
+    process *proc = arg;
+    struct rusage usage;
+    int status;
+
+    if (wait4(proc->pid, &status, WNOHANG, &usage) == proc->pid)
+        updateProcessStatus(proc->pid, status, &usage);
+}
+
+process *addProcess(job *j, cmdLine *stage, pid_t pid) {
+    process *new_process = memCalloc(MEM_JOBS, 1, sizeof(process));
+    process **tail = &j->processes;
+
+    new_process->cmd = stage;
+    new_process->pid = pid;
+    new_process->status = RUNNING;
+    new_process->cpu = -1;
+    new_process->execFd = -1;
+    procSamplerInit(&new_process->sampler);
+    perfInit(&new_process->perf);
+    new_process->job = j;
+
+    while (*tail != NULL)
+        tail = &(*tail)->next;
+    *tail = new_process;
+
+    new_process->pidfd = (int) syscall(SYS_pidfd_open, pid, 0);
+    if (new_process->pidfd != -1 && loopAddFd(new_process->pidfd, EPOLLIN, pidfdReady, new_process) == -1) {
+        close(new_process->pidfd);
+        new_process->pidfd = -1;
+    }
+
+    return new_process;
+}
+
+/* The child's time of exec comes first. Then EOF: the exec closed the child's end; a '!': the exec failed; */
+/* EAGAIN: not exec'ed yet. Writes this small are atomic, a read returns the time whole */
+static void settleExec(process *p) {
+    char notice[sizeof(long long) + 1];
+    ssize_t n;
+
+    while ((n = read(p->execFd, notice, sizeof(notice))) > 0) {
+        if (n >= (ssize_t) sizeof(long long))
+            memcpy(&p->execNs, notice, sizeof(long long));
+        if (n != sizeof(long long)) {      /* the '!', alone or after the time */
+            p->execNs = 0;
+            break;
+        }
+    }
+
+    if (n == -1 && (errno == EAGAIN || errno == EINTR))
+        return;
+
+    loopRemoveFd(p->execFd);
+    close(p->execFd);
+    p->execFd = -1;
+}
+
+static void execReady(int fd, uint32_t events, void *arg) {
+    settleExec(arg);
+}
+
+void watchExec(process *p, int fd) {
+    p->execFd = fd;
+    if (fd != -1 && loopAddFd(fd, EPOLLIN, execReady, p) == -1) {
+        close(fd);
+        p->execFd = -1;
+        p->spawnNs = 0;
+    }
+}
+
+process *findProcess(pid_t pid) {
+    job *j;
+    process *p;
+
+    for (j = global_job_list; j != NULL; j = j->next)
+        for (p = j->processes; p != NULL; p = p->next)
+            if (p->pid == pid)
+                return p;
+
+    return NULL;
+}
+
+job *findJob(int id) {
+    job *j = global_job_list;
+
+    while (j != NULL && j->id != id)
+        j = j->next;
+
+    return j;
+}
+
+static void releaseProcess(process *p) {
+    procSamplerClose(&p->sampler);
+    perfClose(&p->perf);
+
+    if (p->execFd != -1) {
+        loopRemoveFd(p->execFd);
+        close(p->execFd);
+        p->execFd = -1;
+    }
+
+    if (p->pidfd != -1) {
+        loopRemoveFd(p->pidfd);
+        close(p->pidfd);
+        p->pidfd = -1;
+    }
+
+    if (p->cpu != -1) {
+        topologyRelease(p->cpu);
+        p->cpu = -1;
+    }
+}
+
+void updateProcessStatus(pid_t pid, int status, const struct rusage *usage) {
+
+    process *p = findProcess(pid);
+    int new_status = RUNNING;
+
+    if (p == NULL || p->status == TERMINATED)
+        return;
+
+    if (WIFSTOPPED(status))
+        new_status = SUSPENDED;
+
+    else if (WIFEXITED(status) || WIFSIGNALED(status))
+        new_status = TERMINATED;
+
+    else if (WIFCONTINUED(status))
+        new_status = RUNNING;
+
+    p->status = new_status;
+    TRACE(TRACE_WAIT, pid, p->job->pgid, status, p->cmd->arguments[0]);
+
+    if (new_status == TERMINATED) {
+        p->waitStatus = status;
+        if (usage != NULL)
+            p->usage = *usage;
+
+        /* an exec that the loop has not seen yet is found here, its EOF is already waiting */
+        if (p->execFd != -1)
+            settleExec(p);
+        if (options.stats && p->spawnNs != 0)
+            statsRecord(p->cmd->arguments[0], p->spawnNs, p->execNs, statsNow(), status);
+        perfCollect(&p->perf);
+
+        releaseProcess(p);
+
+        /* nobody waits for the command of a substitution, it goes as soon as it is done */
+        if (p->job->substitution && jobStatus(p->job) == TERMINATED)
+            freeJob(p->job);
+    }
+}
+
+void updateProcessList(void) {
+    struct rusage usage;
+    int status;
+    pid_t pid;
+
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0)
+        updateProcessStatus(pid, status, &usage);
+}
+
+int jobStatus(job *j) {
+    process *p;
+    int status = TERMINATED;
+
+    for (p = j->processes; p != NULL; p = p->next) {
+        if (p->status == RUNNING)
+            return RUNNING;
+        if (p->status == SUSPENDED)
+            status = SUSPENDED;
+    }
+
+    return status;
+}
+
+int jobExitStatus(job *j) {
+    process *p = j->processes;
+
+    if (p == NULL)
+        return 0;
+
+    while (p->next != NULL)
+        p = p->next;
+
+    return p->waitStatus;
+}
+
+void reportLimitBreaches(job *j) {
+    process *p;
+    char reason[128];
+
+    if (j->limits == NULL)
+        return;
+
+    fflush(stdout);
+
+    for (p = j->processes; p != NULL; p = p->next)
+        if (p->status == TERMINATED && describeLimitBreach(j->limits, p->waitStatus, &p->usage, reason, sizeof(reason)))
+            fprintf(stderr, "[%d] %s (%d): %s\n", j->id, p->cmd->arguments[0], p->pid, reason);
+}
+
+void reportMeters(job *j) {
+    if (j->meters != NULL)
+        meterReport(j->meters, j->meterCount, j->cmd);
+}
+
+void reportPerf(job *j) {
+    perfCounters total;
+    process *p;
+    char label[32];
+    int stages = 0;
+
+    perfInit(&total);
+
+    fflush(stdout);
+
+    for (p = j->processes; p != NULL; p = p->next) {
+        if (!p->perf.collected)
+            continue;
+        perfPrint(p->cmd->arguments[0], &p->perf);
+        perfAdd(&total, &p->perf);
+        stages++;
+    }
+
+    if (stages > 1) {
+        snprintf(label, sizeof(label), "job [%d]", j->id);
+        perfPrint(label, &total);
+    }
+}
+
+int pendingNotifications(void) {
+    job *j;
+    int pending = 0;
+
+    for (j = global_job_list; j != NULL; j = j->next)
+        if (j->background && !j->substitution && jobStatus(j) != j->notified)
+            pending++;
+
+    return pending;
+}
+
+int notifyJobs(void) {
+    job *j = global_job_list;
+    int printed = 0;
+
+    while (j != NULL) {
+        job *next = j->next;
+        int status = jobStatus(j);
+
+        if (j->background && !j->substitution && status != j->notified) {
+            fprintf(stdout, "[%d] %s\t", j->id, status == TERMINATED ? "Done" : getStatus(status));
+            printJobCommand(stdout, j);
+            fprintf(stdout, "\n");
+            if (status == TERMINATED) {
+                reportLimitBreaches(j);
+                reportMeters(j);
+                reportPerf(j);
+            }
+            j->notified = status;
+            printed++;
+        }
+
+        if (j->background && status == TERMINATED)
+            freeJob(j);
+
+        j = next;
+    }
+
+    return printed;
+}
+
+/* [[d-]hh:]mm:ss like ps */
+static const char *formatElapsed(double seconds, char *buffer, size_t size) {
+    long s = (long) seconds;
+
+    if (s >= 86400)
+        snprintf(buffer, size, "%ld-%02ld:%02ld:%02ld", s / 86400, s / 3600 % 24, s / 60 % 60, s % 60);
+    else if (s >= 3600)
+        snprintf(buffer, size, "%02ld:%02ld:%02ld", s / 3600, s / 60 % 60, s % 60);
+    else
+        snprintf(buffer, size, "%02ld:%02ld", s / 60, s % 60);
+    return buffer;
+}
+
+int printProcessList(FILE *out) {
+    job *j, *next;
+    process *p;
+    procUsage usage;
+    char elapsed[32];
+    int live = 0;
+
+    updateProcessList();
+
+    fprintf(out, "%-5s %8s %6s %9s %4s %11s  %-10s %s\n", "JOB", "PID", "CPU%", "RSS", "THR", "ELAPSED", "STATUS",
+            "COMMAND");
+
+    for (j = global_job_list; j != NULL; j = j->next)
+        for (p = j->processes; p != NULL; p = p->next) {
+            fprintf(out, "[%d]%*s %8d ", j->id, j->id < 10 ? 2 : j->id < 100 ? 1 : 0, "", p->pid);
+
+            /* reaped processes have no /proc entry left */
+            if (p->status != TERMINATED && procSample(&p->sampler, p->pid, &usage) == 0)
+                fprintf(out, "%6.1f %7ldkB %4ld %11s  ", usage.cpuPercent, usage.rssKb, usage.threads,
+                        formatElapsed(usage.elapsed, elapsed, sizeof(elapsed)));
+            else
+                fprintf(out, "%6s %9s %4s %11s  ", "-", "-", "-", "-");
+
+            fprintf(out, "%-10s %s\n", getStatus(p->status), p->cmd->arguments[0]);
+            if (p->status != TERMINATED)
+                live++;
+        }
+
+    /* terminated jobs are shown once */
+    for (j = global_job_list; j != NULL; j = next) {
+        next = j->next;
+        if (j->background && jobStatus(j) == TERMINATED)
+            freeJob(j);
+    }
+
+    return live;
+}
+
+/* ------- Signalling -------------- */
+static const struct {
+    const char *name;
+    int signo;
+} signal_names[] = {
+        {"HUP",  SIGHUP},
+        {"INT",  SIGINT},
+        {"QUIT", SIGQUIT},
+        {"KILL", SIGKILL},
+        {"USR1", SIGUSR1},
+        {"USR2", SIGUSR2},
+        {"TERM", SIGTERM},
+        {"CONT", SIGCONT},
+        {"STOP", SIGSTOP},
+        {"TSTP", SIGTSTP},
+};
+
+int parseSignal(const char *name) {
+    char *end;
+    long signo;
+    size_t i;
+
+    if (strncmp(name, "SIG", 3) == 0)
+        name += 3;
+
+    signo = strtol(name, &end, 10);
+    if (end != name && *end == 0)
+        return (signo > 0 && signo < NSIG) ? (int) signo : -1;
+
+    for (i = 0; i < sizeof(signal_names) / sizeof(signal_names[0]); i++)
+        if (strcmp(signal_names[i].name, name) == 0)
+            return signal_names[i].signo;
+
+    return -1;
+}
+
+typedef struct signalTarget {
+    pid_t pid;
+    int error;                  /* errno of the failed kill, 0 when delivered */
+    const char *name;           /* command of the tracked process, NULL for foreign pids */
+} signalTarget;
+
+typedef struct pidRange {
+    pid_t low, high;
+} pidRange;
+
+static int comparePids(const void *a, const void *b) {
+    pid_t x = ((const signalTarget *) a)->pid, y = ((const signalTarget *) b)->pid;
+    return (x > y) - (x < y);
+}
+
+static int parsePid(const char *str, pid_t *pid) {
+    char *end;
+    long value = strtol(str, &end, 10);
+
+    if (end == str || *end != 0 || value <= 0)
+        return -1;
+
+    *pid = (pid_t) value;
+    return 0;
+}
+
+/* prints pids failing with the same errno, folding consecutive ones into lo-hi */
+static void printFailures(signalTarget *targets, int count, int error) {
+    int i = 0;
+
+    fprintf(stderr, "  %s:", strerror(error));
+    while (i < count) {
+        int first = i;
+
+        if (targets[i].error != error) {
+            i++;
+            continue;
+        }
+        while (i + 1 < count && targets[i + 1].error == error && targets[i + 1].pid == targets[i].pid + 1)
+            i++;
+
+        if (i == first)
+            fprintf(stderr, " %d", targets[first].pid);
+        else
+            fprintf(stderr, " %d-%d", targets[first].pid, targets[i].pid);
+        i++;
+    }
+    fprintf(stderr, "\n");
+}
+
+static int compareNames(const void *a, const void *b) {
+    return strcmp(*(const char *const *) a, *(const char *const *) b);
+}
+
+/* Returns -1 when the table can't grow (already reported), it is left as it was */
+static int addTarget(signalTarget **pids, int *npids, int *capacity, pid_t pid) {
+    signalTarget *grown;
+
+    if (*npids == *capacity) {
+        if ((grown = memRealloc(MEM_JOBS, *pids, *capacity * 2 * sizeof(signalTarget))) == NULL) {
+            perror("signal: can't collect the targets");
+            return -1;
+        }
+        *pids = grown;
+        *capacity *= 2;
+    }
+    (*pids)[*npids].pid = pid;
+    (*pids)[*npids].error = 0;
+    (*pids)[(*npids)++].name = NULL;
+    return 0;
+}
+
+int signalTargets(int signo, char *const *targets, int count) {
+    int capacity = count + 1;
+    signalTarget *pids = memAlloc(MEM_JOBS, capacity * sizeof(signalTarget));
+    pidRange *ranges = memAlloc(MEM_JOBS, (count + 1) * sizeof(pidRange));
+    const char **names;
+    const char *abbrev = sigabbrev_np(signo) ? sigabbrev_np(signo) : "?";
+    int npids = 0, nranges = 0, nnames = 0, groups = 0, failed = 0, delivered = 0, stopped = 0;
+    int i, k;
+    job *j;
+    process *p;
+
+    if (pids == NULL || ranges == NULL) {
+        perror("signal: can't collect the targets");
+        memFree(pids);
+        memFree(ranges);
+        return count;
+    }
+
+    /* jobs and process groups are a single killpg each, pids and ranges are collected first */
+    for (i = 0; i < count && !stopped; i++) {
+        char *target = targets[i];
+        char *dash = strchr(target + 1, '-');
+        pid_t pid, high;
+        job *signalled;
+
+        if (target[0] == '%' || target[0] == '-') {
+            if (parsePid(target + 1, &pid) == -1) {
+                fprintf(stderr, "%s: bad target\n", target);
+                failed++;
+                continue;
+            }
+
+            if (target[0] == '%') {
+                if ((signalled = findJob(pid)) == NULL) {
+                    fprintf(stderr, "%s: no such job\n", target);
+                    failed++;
+                    continue;
+                }
+                pid = signalled->pgid;
+            }
+
+            TRACE(TRACE_SIGNAL, -pid, pid, signo, target);
+            if (killpg(pid, signo) == -1) {
+                fprintf(stderr, "%s: %s\n", target, strerror(errno));
+                failed++;
+            } else
+                groups++;
+        } else if (dash != NULL) {
+            *dash = 0;
+            if (parsePid(target, &pid) == 0 && parsePid(dash + 1, &high) == 0 && pid <= high) {
+                ranges[nranges].low = pid;
+                ranges[nranges++].high = high;
+            } else {
+                fprintf(stderr, "%s-%s: bad pid range\n", target, dash + 1);
+                failed++;
+            }
+            *dash = '-';
+        } else if (parsePid(target, &pid) == 0)
+            stopped = addTarget(&pids, &npids, &capacity, pid) == -1;
+        else {
+            fprintf(stderr, "%s: bad target\n", target);
+            failed++;
+        }
+    }
+
+    /* ranges only cover processes this shell launched, never whatever else owns those numbers */
+    if (nranges > 0 && !stopped) {
+        for (j = global_job_list; j != NULL && !stopped; j = j->next)
+            for (p = j->processes; p != NULL && !stopped; p = p->next) {
+                if (p->status == TERMINATED)
+                    continue;
+                for (k = 0; k < nranges; k++)
+                    if (p->pid >= ranges[k].low && p->pid <= ranges[k].high) {
+                        stopped = addTarget(&pids, &npids, &capacity, p->pid) == -1;
+                        break;
+                    }
+            }
+    }
+
+    /* a partial table is not sent at all: the groups already signalled are all that went out */
+    if (stopped) {
+        memFree(ranges);
+        memFree(pids);
+        return failed + 1;
+    }
+
+    qsort(pids, npids, sizeof(signalTarget), comparePids);
+    for (i = 0, k = 0; i < npids; i++)
+        if (k == 0 || pids[k - 1].pid != pids[i].pid)
+            pids[k++] = pids[i];
+    npids = k;
+
+    for (i = 0; i < npids; i++) {
+        TRACE(TRACE_SIGNAL, pids[i].pid, -1, signo, "kill");
+        if (kill(pids[i].pid, signo) == -1) {
+            pids[i].error = errno;
+            failed++;
+        } else
+            delivered++;
+    }
+
+    /* one walk over the table names every signalled process */
+    for (j = global_job_list; j != NULL; j = j->next)
+        for (p = j->processes; p != NULL; p = p->next) {
+            signalTarget key, *found;
+            key.pid = p->pid;
+            found = bsearch(&key, pids, npids, sizeof(signalTarget), comparePids);
+            if (found != NULL)
+                found->name = p->cmd->arguments[0];
+        }
+
+    /* the signals are out already, without room for the names only the summary is printed */
+    if ((names = memAlloc(MEM_JOBS, (npids + 1) * sizeof(char *))) == NULL)
+        perror("signal: can't list the signalled commands");
+    for (i = 0; i < npids && names != NULL; i++)
+        if (pids[i].error == 0 && pids[i].name != NULL)
+            names[nnames++] = pids[i].name;
+    if (nnames > 0)
+        qsort(names, nnames, sizeof(char *), compareNames);
+
+    for (i = 0; i < nnames; i = k) {
+        for (k = i + 1; k < nnames && strcmp(names[k], names[i]) == 0; k++);
+        if (k - i == 1)
+            printf("%s handling SIG%s\n", names[i], abbrev);
+        else
+            printf("%s handling SIG%s (x%d)\n", names[i], abbrev, k - i);
+    }
+
+    if (npids + groups > 1 || failed > 0)
+        printf("SIG%s: %d processes, %d process groups, %d failed\n", abbrev, delivered, groups, failed);
+
+    for (i = 0; i < npids; i++) {
+        int error = pids[i].error, seen = 0;
+
+        if (error == 0)
+            continue;
+        for (k = 0; k < i && !seen; k++)
+            seen = pids[k].error == error;
+        if (!seen)
+            printFailures(pids, npids, error);
+    }
+
+    memFree(names);
+    memFree(ranges);
+    memFree(pids);
+    return failed;
+}
+
+void freeJob(job *j) {
+    job **link = &global_job_list;
+    process *p = j->processes;
+
+    while (*link != NULL && *link != j)
+        link = &(*link)->next;
+    if (*link == j)
+        *link = j->next;
+
+    while (p != NULL) {
+        process *next = p->next;
+        releaseProcess(p);
+        memFree(p);
+        p = next;
+    }
+
+    freeCmdLines(j->cmd);
+    memFree(j->limits);
+    meterFree(j->meters, j->meterCount);
+    memFree(j);
+}
+
+void freeJobList(void) {
+    while (global_job_list != NULL)
+        freeJob(global_job_list);
+}
@@ -0,0 +1,110 @@
+//
+// Process table of the shell: every launched pipeline is a job holding one process per stage.
+//
+
+#ifndef LAB6_JOBS_H
+#define LAB6_JOBS_H
+
+#include "LineParser.h"
+#include "resourceLimits.h"
+#include "meter.h"
+#include "procinfo.h"
+#include "perfCounters.h"
+#include <stdio.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+
+#define TERMINATED  -1
+#define RUNNING 1
+#define SUSPENDED 0
+
+struct job;
+
+typedef struct process {
+    cmdLine *cmd;           /* the stage this process runs (owned by the job) */
+    pid_t pid;
+    int status;             /* RUNNING, SUSPENDED or TERMINATED */
+    int waitStatus;         /* raw status from waitpid once TERMINATED */
+    struct rusage usage;    /* resources used by the stage, filled when reaped */
+    int pidfd;              /* -1 when pidfd_open is not available */
+    int cpu;                /* cpu reserved by topology placement, -1 when not placed */
+    long long spawnNs;      /* fork, exec and exit times for the stats builtin (0 when unknown) */
+    long long execNs;
+    int execFd;             /* exec-notify pipe still watched, -1 once exec is settled */
+    procSampler sampler;    /* /proc usage for showprocs */
+    perfCounters perf;      /* set perf on: counters attached before exec, totals once reaped */
+    struct job *job;
+    struct process *next;   /* next stage of the same job */
+} process;
+
+typedef struct job {
+    int id;
+    pid_t pgid;
+    cmdLine *cmd;           /* head of the chain, freed with the job */
+    process *processes;
+    limitSet *limits;       /* limit prefix applied to every stage, NULL when none */
+    meterStats *meters;     /* shared stats of the meter stages, NULL when none */
+    int meterCount;
+    int background;         /* 1 once the shell stopped waiting for the job */
+    int notified;           /* last state reported to the user */
+    int substitution;       /* 1 for the command of a <(...) or >(...): reaped without reports */
+    struct job *next;
+} job;
+
+extern job *global_job_list;
+
+char *getStatus(int status);
+
+/* Creates a job owning cmd and appends it to the job list */
+job *addJob(cmdLine *cmd, int background);
+
+/* Adds a launched stage to the job. Watches it with a pidfd when possible */
+process *addProcess(job *j, cmdLine *stage, pid_t pid);
+
+/* Watches the exec-notify pipe of p (fd from the launcher, -1 when stats are off) */
+void watchExec(process *p, int fd);
+
+process *findProcess(pid_t pid);
+job *findJob(int id);
+
+/* Records a status returned by wait4 for pid. usage may be NULL for state changes other than exits */
+void updateProcessStatus(pid_t pid, int status, const struct rusage *usage);
+
+/* Reaps every child that changed state without blocking */
+void updateProcessList(void);
+
+int jobStatus(job *j);          /* RUNNING if a stage runs, else SUSPENDED if one is stopped, else TERMINATED */
+int jobExitStatus(job *j);      /* wait status of the last stage */
+
+/* Prints the stages of a terminated job that died from one of its resource limits */
+void reportLimitBreaches(job *j);
+
+/* Prints the throughput seen by the meter stages of a terminated job */
+void reportMeters(job *j);
+
+/* Prints the perf counter totals of every stage of a terminated job, and of the job */
+void reportPerf(job *j);
+
+/* Number of background jobs whose state changed since it was last reported */
+int pendingNotifications(void);
+
+/* Prints background jobs that finished or stopped since the last call and drops finished ones */
+/* Returns the number of printed lines */
+int notifyJobs(void);
+
+/* Prints every tracked process with its live CPU, RSS, threads and elapsed time to out */
+/* Returns the number of processes still running or stopped */
+int printProcessList(FILE *out);
+
+/* Parses a signal given as a number, INT or SIGINT. Returns -1 when unknown */
+int parseSignal(const char *name);
+
+/* Sends signo to every target in one pass and prints a summary */
+/* targets: pid, pid range lo-hi (tracked processes only), %job (its process group), -pgid */
+/* Returns the number of failed deliveries */
+int signalTargets(int signo, char *const *targets, int count);
+
+void freeJob(job *j);
+void freeJobList(void);
+
+#endif //LAB6_JOBS_H
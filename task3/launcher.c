@@ -0,0 +1,601 @@
+#define _GNU_SOURCE
+#include "launcher.h"
+#include "eventLoop.h"
+#include "schedAttrs.h"
+#include "topology.h"
+#include "options.h"
+#include "fusion.h"
+#include "trace.h"
+#include "stats.h"
+#include "memstat.h"
+#include "pathIndex.h"
+#include "variables.h"
+#include <linux/limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <termios.h>
+
+job *foreground_job = NULL;
+
+static int interactive_shell = 0;
+
+/* child side: write end of the exec-notify pipe of the stage, -1 when stats are off. It gets the */
+/* statsNow() time of the exec, then a '!' when the exec failed */
+static int exec_notify = -1;
+
+/* child side: read end of the perf gate, closed by the shell once the counters are attached */
+static int perf_gate = -1;
+
+/* the exported variables, packed before the forks so no child allocates them */
+static char *const *exec_environment = NULL;
+
+void launcherInit(int interactive) {
+    interactive_shell = interactive;
+}
+
+/* ----- Printing ----- */
+void printDebug(char *buffer, int pid, int debug) {
+    TRACE(TRACE_DEBUG, pid, -1, pid, buffer);
+
+    if (debug == 1) {
+        if (pid != -1)
+            fprintf(stderr, "(%s: %d)\n", buffer, pid);
+        else
+            fprintf(stderr, "%s\n", buffer);
+    }
+}
+
+/* ----- Child side ----- */
+static void redirectInput(cmdLine *command) {
+    int fd_input = open(command->inputRedirect, READ_FLAGS, READ_MODES);
+
+    if (fd_input == -1) {
+        perror("Failed to open the file given as input...");
+        _exit(EXIT_FAILURE);
+    }
+
+    if (dup2(fd_input, STDIN_FILENO) == -1) {
+        perror("Failed to redirect standard input...");
+        _exit(EXIT_FAILURE);
+    }
+    TRACE(TRACE_DUP2, getpid(), getpgrp(), STDIN_FILENO, command->inputRedirect);
+
+    if (close(fd_input) == -1) {
+        perror("Failed to close the input file...");
+        _exit(EXIT_FAILURE);
+    }
+}
+
+static void redirectOutput(cmdLine *command) {
+    int fd_output = open(command->outputRedirect, APPEND_FLAGS, CREATE_MODES);
+
+    if (fd_output == -1) {
+        perror("Failed to create or append to the file given as input...");
+        _exit(EXIT_FAILURE);
+    }
+
+    if (dup2(fd_output, STDOUT_FILENO) == -1) {
+        perror("Failed to redirect standard error...");
+        _exit(EXIT_FAILURE);
+    }
+    TRACE(TRACE_DUP2, getpid(), getpgrp(), STDOUT_FILENO, command->outputRedirect);
+
+    if (close(fd_output) == -1) {
+        perror("Failed to close the output file...");
+        _exit(EXIT_FAILURE);
+    }
+}
+
+/* the sealed memfd behind << and <<< becomes stdin, like an input redirection */
+static void redirectHereDocument(int fd_here) {
+    if (dup2(fd_here, STDIN_FILENO) == -1) {
+        perror("Failed to redirect standard input to the here-document...");
+        _exit(EXIT_FAILURE);
+    }
+    TRACE(TRACE_DUP2, getpid(), getpgrp(), STDIN_FILENO, "here-document");
+}
+
+/* process group, signal state, limits and placement every stage gets before exec */
+static void setupChild(job *j, const schedAttrs *placement) {
+    pid_t pgid = j->pgid ? j->pgid : getpid();
+
+    setpgid(0, pgid);
+    if (interactive_shell && !j->background)
+        tcsetpgrp(STDIN_FILENO, pgid);
+
+    loopChildReset();
+
+    if (j->limits != NULL)
+        applyLimits(j->limits);
+
+    applySchedAttrs(placement);
+}
+
+/* process substitution: the /dev/fd/N named in the arguments must survive exec */
+static void keepInheritedFds(cmdLine *command) {
+    int i;
+
+    for (i = 0; i < command->inheritedCount; i++)
+        fcntl(command->inheritedFds[i], F_SETFD, 0);
+}
+
+static void execStage(cmdLine *command) {
+    char ready, path[PATH_MAX];
+    const char *dir;
+    long long now;
+
+    /* enable_on_exec: the counters have to be in place before the exec they start on */
+    if (perf_gate != -1)
+        while (read(perf_gate, &ready, 1) == -1 && errno == EINTR);
+
+    /* the exec time comes from here: the shell only reads the pipe whenever its loop gets to it */
+    if (exec_notify != -1) {
+        now = statsNow();
+        write(exec_notify, &now, sizeof(now));
+    }
+
+    TRACE(TRACE_EXEC, getpid(), getpgrp(), command->argCount, command->arguments[0]);
+
+    /* the index knows the directory, execvp would try each PATH entry before it */
+    if (strchr(command->arguments[0], '/') == NULL && (dir = pathLookup(command->arguments[0])) != NULL
+        && (size_t) snprintf(path, sizeof(path), "%s/%s", dir, command->arguments[0]) < sizeof(path))
+        execve(path, command->arguments, exec_environment);
+
+    execvpe(command->arguments[0], command->arguments, exec_environment); //execvpe only file name
+    if (exec_notify != -1)
+        write(exec_notify, "!", 1);
+    perror("Could not execute the command");
+    _exit(127);
+}
+
+/* a meter stage is the forked shell itself relaying bytes, everything else is exec'ed */
+static void runStage(job *j, cmdLine *command) {
+    if (isMeterStage(command))
+        meterRun(&j->meters[meterSlot(j->cmd, command)]);
+    execStage(command);
+}
+
+/* ----- Parent side ----- */
+
+/* Copies a here-document into a sealed memfd: no file on disk and no pipe a large body could fill */
+/* Returns the fd positioned at offset 0, -1 on failure */
+static int createHereDocument(const char *body) {
+    size_t length = strlen(body), written = 0;
+    int fd = memfd_create("heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+    if (fd == -1) {
+        perror("memfd_create failed");
+        return -1;
+    }
+
+    while (written < length) {
+        ssize_t n = write(fd, body + written, length - written);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("Failed to write the here-document...");
+            close(fd);
+            return -1;
+        }
+        written += n;
+    }
+
+    if (fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == -1)
+        perror("Failed to seal the here-document...");
+
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+/* strips the limit and sched prefixes; limit only on the first stage, sched on any (-j for all of them) */
+static int parsePrefixes(cmdLine *command, limitSet *limits, int *limited, schedAttrs *placement) {
+    schedAttrs job_attrs, attrs;
+    cmdLine *stage;
+    int found, job_wide;
+
+    memset(&job_attrs, 0, sizeof(job_attrs));
+    *limited = 0;
+
+    for (stage = command; stage != NULL; stage = stage->next) {
+        do {
+            found = 0;
+
+            if (stage == command && !*limited) {
+                if ((*limited = parseLimitPrefix(stage, limits)) == -1)
+                    return -1;
+                found = *limited;
+            }
+
+            switch (parseSchedPrefix(stage, &attrs, &job_wide)) {
+                case -1:
+                    return -1;
+                case 1:
+                    found = 1;
+                    /* the innermost prefix wins */
+                    mergeSchedAttrs(&attrs, job_wide ? &job_attrs : &placement[stage->idx]);
+                    if (job_wide)
+                        job_attrs = attrs;
+                    else
+                        placement[stage->idx] = attrs;
+                    break;
+            }
+        } while (found);
+    }
+
+    for (stage = command; stage != NULL; stage = stage->next)
+        mergeSchedAttrs(&placement[stage->idx], &job_attrs);
+
+    return 0;
+}
+
+/* Forks a stage. For the stats builtin the child keeps the write end of a CLOEXEC pipe: it writes */
+/* its time of exec, then a successful exec closes it (EOF in the shell), a failed one writes a '!' */
+/* *notify is the shell's read end, -1 when stats are off */
+/* With perf on, the child also waits on *gate (the shell's write end, -1 when off) before exec */
+/* A meter stage never execs and gets neither */
+static pid_t forkStage(cmdLine *command, long long *spawned, int *notify, int *gate) {
+    int ends[2] = {-1, -1}, gate_ends[2] = {-1, -1};
+    int execs = !isMeterStage(command);
+    pid_t pid;
+
+    if (options.stats && execs && pipe2(ends, O_CLOEXEC | O_NONBLOCK) == -1)
+        ends[0] = ends[1] = -1;
+    if (options.perf && execs && pipe2(gate_ends, O_CLOEXEC) == -1)
+        gate_ends[0] = gate_ends[1] = -1;
+
+    *spawned = statsNow();
+    pid = fork();
+
+    if (pid == 0) {
+        if (ends[0] != -1)
+            close(ends[0]);
+        exec_notify = ends[1];
+        if (gate_ends[1] != -1)
+            close(gate_ends[1]);
+        perf_gate = gate_ends[0];
+        return 0;
+    }
+
+    if (ends[1] != -1)
+        close(ends[1]);
+    if (gate_ends[0] != -1)
+        close(gate_ends[0]);
+    if (pid == -1) {
+        if (ends[0] != -1)
+            close(ends[0]);
+        if (gate_ends[1] != -1)
+            close(gate_ends[1]);
+        ends[0] = gate_ends[1] = -1;
+    }
+
+    *notify = ends[0];
+    *gate = gate_ends[1];
+    return pid;
+}
+
+static void trackChild(job *j, cmdLine *command, pid_t pid, int cpu, long long spawned, int notify, int gate,
+                       int debug) {
+    static int perf_warned = 0;
+    process *p;
+
+    if (j->pgid == 0)
+        j->pgid = pid;
+    setpgid(pid, j->pgid); /* both sides set it, whoever runs first wins the race */
+
+    p = addProcess(j, command, pid);
+    p->cpu = cpu;
+    /* without a notify pipe (stats off, a meter stage) there is no exec to time, stats leaves it out */
+    p->spawnNs = notify != -1 ? spawned : 0;
+    watchExec(p, notify);
+
+    if (gate != -1) {
+        if (perfAttach(&p->perf, pid) == -1 && !perf_warned) {
+            perror("perf_event_open");
+            perf_warned = 1;
+        }
+        close(gate);
+    }
+    TRACE(TRACE_FORK, pid, j->pgid, command->idx, command->arguments[0]);
+
+    printDebug("Executing command", pid, debug);
+}
+
+/* `set topology on`: pipelines get neighbouring cache-sharing cpus, background jobs spread out */
+/* cpus[idx] is the reserved cpu of each auto-placed stage, -1 for the rest */
+static void placeStages(cmdLine *command, int counter, int background, schedAttrs *placement, int *cpus, int debug) {
+    cmdLine *stage;
+    char message[64];
+
+    for (stage = command; stage != NULL; stage = stage->next)
+        cpus[stage->idx] = -1;
+
+    if (!options.topology || (counter == 1 && !background) || topologyPlace(counter, cpus) == -1)
+        return;
+
+    for (stage = command; stage != NULL; stage = stage->next) {
+        /* an explicit sched cpus= wins over the automatic choice */
+        if (placement[stage->idx].hasCpus) {
+            topologyRelease(cpus[stage->idx]);
+            cpus[stage->idx] = -1;
+            continue;
+        }
+
+        placement[stage->idx].hasCpus = 1;
+        CPU_ZERO(&placement[stage->idx].cpus);
+        CPU_SET(cpus[stage->idx], &placement[stage->idx].cpus);
+
+        snprintf(message, sizeof(message), "topology: %s on cpu", stage->arguments[0]);
+        printDebug(message, cpus[stage->idx], debug);
+    }
+}
+
+int waitForJob(job *j) {
+    int status;
+
+    foreground_job = j;
+    if (interactive_shell)
+        tcsetpgrp(STDIN_FILENO, j->pgid);
+
+    while (jobStatus(j) == RUNNING) {
+        if (loopRunOnce(-1) == -1)
+            break;
+    }
+
+    if (interactive_shell)
+        tcsetpgrp(STDIN_FILENO, getpgrp());
+    foreground_job = NULL;
+
+    status = jobExitStatus(j);
+
+    if (jobStatus(j) == SUSPENDED) {
+        /* ctrl-z: the job keeps living in the background list */
+        fprintf(stdout, "\n");
+        j->background = 1;
+        notifyJobs();
+    } else {
+        reportLimitBreaches(j);
+        reportMeters(j);
+        reportPerf(j);
+        freeJob(j);
+    }
+
+    return status;
+}
+
+job *launchJob(cmdLine *command, int debug, int counter, int inputFd, int outputFd) {
+    pid_t pid;
+    int **pipes, notify, gate;
+    long long spawned;
+    cmdLine *last = command;
+    limitSet limits;
+    int limited;
+    schedAttrs *placement;
+    int *cpus, *here_fds;
+    cmdLine *stage;
+    job *j;
+
+    /* a program installed or removed since the last event loop turn */
+    pathIndexSync();
+    exec_environment = varEnvironment();
+
+    if (options.fuse && counter > 1) {
+        last = command = fusePipeline(command, debug);
+        counter = cmdCounter(command, debug);
+    }
+
+    if (options.meter && counter > 1) {
+        command = meterInsert(command);
+        counter = cmdCounter(command, debug);
+    }
+
+    placement = memCalloc(MEM_JOBS, counter, sizeof(schedAttrs));
+    cpus = memAlloc(MEM_JOBS, counter * sizeof(int));
+    here_fds = memAlloc(MEM_JOBS, counter * sizeof(int));
+
+    for (stage = command; stage != NULL; stage = stage->next)
+        here_fds[stage->idx] = -1;
+
+    if (parsePrefixes(command, &limits, &limited, placement) == -1) {
+        memFree(here_fds);
+        memFree(cpus);
+        memFree(placement);
+        freeCmdLines(command);
+        return NULL;
+    }
+
+    while (last->next != NULL)
+        last = last->next;
+
+    j = addJob(command, !last->blocking);
+    j->meters = meterCreate(command, &j->meterCount);
+    if (limited) {
+        j->limits = memAlloc(MEM_JOBS, sizeof(limitSet));
+        *j->limits = limits;
+    }
+
+    placeStages(command, counter, j->background, placement, cpus, debug);
+
+    for (stage = command; stage != NULL; stage = stage->next)
+        if (stage->hereDocument != NULL)
+            here_fds[stage->idx] = createHereDocument(stage->hereDocument);
+
+    if (counter > 1) { // if we have few commands, need to create pipe
+        pipes = createPipes(counter - 1);
+        TRACE(TRACE_PIPE, -1, -1, counter - 1, command->arguments[0]);
+        cmdLine *cur_command = command;
+
+        while (cur_command != NULL) {
+
+            if ((pid = forkStage(cur_command, &spawned, &notify, &gate)) == -1) {
+                perror("cant fork");
+                break;
+            } else if (pid == 0) {
+                /*child*/
+                setupChild(j, &placement[cur_command->idx]);
+
+                if (cur_command->inputRedirect)
+                    redirectInput(cur_command);
+                else if (inputFd != -1 && cur_command == command && here_fds[0] == -1) {
+                    dup2(inputFd, STDIN_FILENO);
+                    TRACE(TRACE_DUP2, getpid(), getpgrp(), STDIN_FILENO, "substitution");
+                }
+
+                if (here_fds[cur_command->idx] != -1)
+                    redirectHereDocument(here_fds[cur_command->idx]);
+
+                if (cur_command->outputRedirect)
+                    redirectOutput(cur_command);
+
+                //check if there is left command
+                if (leftPipe(pipes, cur_command) != NULL) {
+                    dup2(pipes[cur_command->idx - 1][0], 0);/*replace the read end to our file */
+                    TRACE(TRACE_DUP2, getpid(), getpgrp(), STDIN_FILENO, "pipe");
+                }
+
+                //check if there is right command
+                if (rightPipe(pipes, cur_command) != NULL) {
+                    dup2(pipes[cur_command->idx][1], 1); /*replace the write-end to our file */
+                    TRACE(TRACE_DUP2, getpid(), getpgrp(), STDOUT_FILENO, "pipe");
+                } else if (outputFd != -1 && !cur_command->outputRedirect) {
+                    dup2(outputFd, STDOUT_FILENO);
+                    TRACE(TRACE_DUP2, getpid(), getpgrp(), STDOUT_FILENO, "substitution");
+                }
+
+                keepInheritedFds(cur_command);
+
+                /* the remaining pipe ends are O_CLOEXEC and vanish on exec */
+                runStage(j, cur_command);
+            } else {/*parent code*/
+                trackChild(j, cur_command, pid, cpus[cur_command->idx], spawned, notify, gate, debug);
+                cpus[cur_command->idx] = -1;
+
+                /* stages run concurrently, the parent only drops the ends it handed over */
+                if (rightPipe(pipes, cur_command) != NULL) {
+                    close(pipes[cur_command->idx][1]);
+                }
+
+                //check if it is the first command - if not close read channel
+                if (leftPipe(pipes, cur_command) != NULL) {
+                    close(pipes[cur_command->idx - 1][0]);
+                }
+
+                cur_command = cur_command->next;
+            }
+        }
+
+        /* a failed fork leaves the ends of the stages that never started */
+        for (; cur_command != NULL; cur_command = cur_command->next) {
+            if (rightPipe(pipes, cur_command) != NULL)
+                close(pipes[cur_command->idx][1]);
+            if (leftPipe(pipes, cur_command) != NULL)
+                close(pipes[cur_command->idx - 1][0]);
+        }
+        releasePipes(pipes, counter - 1);
+    }
+/*    set follow-fork-mode child    */
+/*    set detach-on-fork off        */
+/*    ls | tee | tail -n 2     */
+    else {/*the old shell */
+        pid = forkStage(command, &spawned, &notify, &gate);
+        if (pid == 0) {
+            setupChild(j, &placement[0]);
+
+            if (command->inputRedirect)
+                redirectInput(command);
+            else if (inputFd != -1 && here_fds[0] == -1) {
+                dup2(inputFd, STDIN_FILENO);
+                TRACE(TRACE_DUP2, getpid(), getpgrp(), STDIN_FILENO, "substitution");
+            }
+
+            if (here_fds[0] != -1)
+                redirectHereDocument(here_fds[0]);
+
+            if (command->outputRedirect)
+                redirectOutput(command);
+            else if (outputFd != -1) {
+                dup2(outputFd, STDOUT_FILENO);
+                TRACE(TRACE_DUP2, getpid(), getpgrp(), STDOUT_FILENO, "substitution");
+            }
+
+            keepInheritedFds(command);
+            runStage(j, command);
+        } else if (pid == -1)
+            perror("cant fork");
+        else {
+            trackChild(j, command, pid, cpus[0], spawned, notify, gate, debug);
+            cpus[0] = -1;
+        }
+    }
+
+    /* reservations of stages that never started, and the parent's copies of the here-documents */
+    /* and of the substitution pipes (a >(...) reader only sees EOF once they are gone) */
+    for (stage = command; stage != NULL; stage = stage->next) {
+        if (cpus[stage->idx] != -1)
+            topologyRelease(cpus[stage->idx]);
+        if (here_fds[stage->idx] != -1)
+            close(here_fds[stage->idx]);
+        closeInheritedFds(stage);
+    }
+    memFree(here_fds);
+    memFree(cpus);
+    memFree(placement);
+
+    if (j->processes == NULL) {
+        freeJob(j);
+        return NULL;
+    }
+
+    return j;
+}
+
+int execute(cmdLine *command, int debug, int counter) {
+    job *j = launchJob(command, debug, counter, -1, -1);
+
+    if (j == NULL)
+        return -1;
+
+    if (j->background) {
+        fprintf(stdout, "[%d] %d\n", j->id, j->pgid);
+        fflush(stdout);     /* before the output of whatever the rest of the line runs */
+        return 0;
+    }
+
+    return waitForJob(j);
+}
+
+int exitCode(int waitStatus) {
+    if (waitStatus == -1)
+        return EXIT_FAILURE;
+    if (WIFSIGNALED(waitStatus))
+        return 128 + WTERMSIG(waitStatus);
+    if (WIFSTOPPED(waitStatus))
+        return 128 + WSTOPSIG(waitStatus);
+    return WEXITSTATUS(waitStatus);
+}
+
+int listRuns(char connector, int status) {
+    if (connector == LIST_AND)
+        return status == 0;
+    if (connector == LIST_OR)
+        return status != 0;
+    return 1;
+}
+
+int cmdCounter(cmdLine *command, int debug) {
+    int counter = 1;
+    cmdLine *cur_command = command;
+    while (cur_command->next) {
+        cur_command = cur_command->next;
+        counter++;
+    }
+    return counter;;
+}
@@ -0,0 +1,47 @@
+//
+// Launching parsed command lines: forks every stage of the chain, wires the pipes and waits for foreground jobs.
+//
+
+#ifndef LAB6_LAUNCHER_H
+#define LAB6_LAUNCHER_H
+
+#include "pipeHelper.h"
+#include "jobs.h"
+
+#define READ_FLAGS (O_RDONLY)
+#define CREATE_FLAGS (O_WRONLY | O_CREAT | O_TRUNC)
+#define APPEND_FLAGS (O_WRONLY | O_CREAT | O_APPEND)
+#define READ_MODES (S_IRUSR | S_IRGRP | S_IROTH)
+#define CREATE_MODES (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)
+
+/* job the shell is currently waiting for, NULL at the prompt */
+extern job *foreground_job;
+
+/* interactive shells hand the terminal to their foreground jobs */
+void launcherInit(int interactive);
+
+void printDebug(char *buffer, int pid, int debug);
+
+/* Forks every stage of the chain as one job without waiting for it. The job takes ownership of command */
+/* When inputFd is not -1 the first stage reads it instead of stdin, and when outputFd is not -1 */
+/* the last stage writes to it instead of stdout (unless they redirect themselves) */
+/* Returns the job, NULL when nothing was started */
+job *launchJob(cmdLine *command, int debug, int counter, int inputFd, int outputFd);
+
+/* Launches the chain as one job. The job takes ownership of command */
+/* Returns the wait status of the last stage for foreground jobs, 0 for background jobs */
+int execute(cmdLine *command, int debug, int counter);
+
+/* Runs the event loop until no stage of j is running. Frees j when it terminated */
+/* Returns the wait status of the last stage */
+int waitForJob(job *j);
+
+int cmdCounter(cmdLine *command, int debug);
+
+/* Exit code of a wait status: the exit status, 128 + the signal that killed or stopped it, 1 when nothing ran (-1) */
+int exitCode(int waitStatus);
+
+/* 1 when the pipeline after connector runs, given the exit code of the last pipeline that ran */
+int listRuns(char connector, int status);
+
+#endif //LAB6_LAUNCHER_H
@@ -0,0 +1,352 @@
+#define _GNU_SOURCE
+#include "lineEditor.h"
+#include "pathIndex.h"
+#include "memstat.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <termios.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#define EDITOR_LINE_SIZE 2048       /* the shell's input buffer */
+#define LIST_LIMIT 256              /* completions listed at most */
+
+typedef struct candidates {
+    char **names;           /* the rest of the word they complete to, from its last '/' on */
+    size_t count, capacity;
+} candidates;
+
+static int terminal = -1;
+static struct termios shell_mode;
+static const char *const *builtin_names = NULL;
+static void (*show_prompt)(void) = NULL;
+
+static int editing = 0;
+static char text[EDITOR_LINE_SIZE];
+static size_t length = 0;
+static int escape = 0;      /* 1 after ESC, 2 inside a CSI or SS3 sequence (arrow keys): swallowed */
+static int tabbed = 0;      /* the previous key was a Tab that could not extend the word */
+
+int editorInit(int fd, const char *const *builtins, void (*prompt)(void)) {
+    if (tcgetattr(fd, &shell_mode) == -1)
+        return -1;
+
+    terminal = fd;
+    builtin_names = builtins;
+    show_prompt = prompt;
+    return 0;
+}
+
+void editorStart(void) {
+    struct termios raw = shell_mode;
+
+    if (terminal == -1)
+        return;
+
+    /* ISIG stays: ctrl-C and ctrl-Z still reach the shell through its signalfd */
+    raw.c_lflag &= ~(ICANON | ECHO);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(terminal, TCSANOW, &raw);
+
+    length = 0;
+    escape = tabbed = 0;
+    editing = 1;
+}
+
+void editorStop(void) {
+    if (!editing)
+        return;
+
+    tcsetattr(terminal, TCSANOW, &shell_mode);
+    editing = 0;
+}
+
+int editorActive(void) {
+    return editing;
+}
+
+void editorRedraw(void) {
+    if (editing && length > 0) {
+        fwrite(text, 1, length, stdout);
+        fflush(stdout);
+    }
+}
+
+void editorLine(char *line, size_t size) {
+    snprintf(line, size, "%.*s\n", (int) length, text);
+}
+
+/* ----- Editing ----- */
+static void bell(void) {
+    fputc('\a', stdout);
+    fflush(stdout);
+}
+
+static void insert(const char *str, size_t n) {
+    if (length + n >= EDITOR_LINE_SIZE - 1) {
+        bell();
+        return;
+    }
+
+    memcpy(text + length, str, n);
+    length += n;
+    fwrite(str, 1, n, stdout);
+    fflush(stdout);
+}
+
+/* one character back, with all the bytes of a UTF-8 sequence */
+static void eraseChar(void) {
+    if (length == 0)
+        return;
+
+    do
+        length--;
+    while (length > 0 && (text[length] & 0xC0) == 0x80);
+
+    fputs("\b \b", stdout);
+}
+
+static void eraseWord(void) {
+    while (length > 0 && text[length - 1] == ' ')
+        eraseChar();
+    while (length > 0 && text[length - 1] != ' ')
+        eraseChar();
+}
+
+/* ----- Completion ----- */
+static void addCandidate(candidates *c, const char *name, const char *suffix) {
+    if (c->count == c->capacity) {
+        c->capacity = c->capacity ? c->capacity * 2 : 64;
+        c->names = memRealloc(MEM_COMMANDS, c->names, c->capacity * sizeof(char *));
+    }
+
+    c->names[c->count] = memAlloc(MEM_COMMANDS, strlen(name) + strlen(suffix) + 1);
+    strcpy(stpcpy(c->names[c->count], name), suffix);
+    c->count++;
+}
+
+static void freeCandidates(candidates *c) {
+    size_t i;
+
+    for (i = 0; i < c->count; i++)
+        memFree(c->names[i]);
+    memFree(c->names);
+}
+
+static int compareNames(const void *a, const void *b) {
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/* sorted, a builtin also found in PATH once */
+static void sortUnique(candidates *c) {
+    size_t i, kept = 0;
+
+    qsort(c->names, c->count, sizeof(char *), compareNames);
+    for (i = 0; i < c->count; i++) {
+        if (kept > 0 && strcmp(c->names[kept - 1], c->names[i]) == 0)
+            memFree(c->names[i]);
+        else
+            c->names[kept++] = c->names[i];
+    }
+    c->count = kept;
+}
+
+static void commandCandidates(candidates *c, const char *word, size_t wordLength) {
+    size_t first, count, i;
+
+    /* a program installed a moment ago is already in */
+    pathIndexSync();
+
+    count = pathRange(word, wordLength, &first);
+    for (i = 0; i < count; i++)
+        addCandidate(c, pathName(first + i), "");
+
+    for (i = 0; builtin_names != NULL && builtin_names[i] != NULL; i++)
+        if (strncmp(builtin_names[i], word, wordLength) == 0)
+            addCandidate(c, builtin_names[i], "");
+}
+
+/* entries of the directory part of word starting with its last component, directories with a '/' */
+static void fileCandidates(candidates *c, const char *word) {
+    const char *slash = strrchr(word, '/'), *base = slash ? slash + 1 : word;
+    size_t baseLength = strlen(base);
+    char dir[EDITOR_LINE_SIZE];
+    struct dirent *e;
+    struct stat st;
+    DIR *d;
+
+    if (slash == NULL)
+        strcpy(dir, ".");
+    else
+        snprintf(dir, sizeof(dir), "%.*s", slash == word ? 1 : (int) (slash - word), word);
+
+    if ((d = opendir(dir)) == NULL)
+        return;
+
+    while ((e = readdir(d)) != NULL) {
+        int isDir;
+
+        if (strncmp(e->d_name, base, baseLength) != 0 || (e->d_name[0] == '.' && base[0] != '.')
+            || strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0)
+            continue;
+
+        isDir = e->d_type == DT_DIR
+                || ((e->d_type == DT_LNK || e->d_type == DT_UNKNOWN)
+                    && fstatat(dirfd(d), e->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode));
+        addCandidate(c, e->d_name, isDir ? "/" : "");
+    }
+
+    closedir(d);
+}
+
+/* the word being completed starts after the last separator */
+static size_t wordStart(void) {
+    size_t i = length;
+
+    while (i > 0 && strchr(" |;&<>(", text[i - 1]) == NULL)
+        i--;
+    return i;
+}
+
+/* first word of a pipeline: a command name */
+static int commandPosition(size_t start) {
+    while (start > 0 && text[start - 1] == ' ')
+        start--;
+    return start == 0 || strchr("|;&(", text[start - 1]) != NULL;
+}
+
+static size_t commonPrefix(const candidates *c) {
+    size_t common = strlen(c->names[0]), i, j;
+
+    for (i = 1; i < c->count; i++) {
+        for (j = 0; j < common && c->names[i][j] == c->names[0][j]; j++);
+        common = j;
+    }
+    return common;
+}
+
+/* in columns under the line, then the prompt and the line again */
+static void listCandidates(const candidates *c) {
+    struct winsize ws;
+    size_t width = 80, widest = 0, columns, shown = c->count < LIST_LIMIT ? c->count : LIST_LIMIT, i;
+
+    if (ioctl(terminal, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0)
+        width = ws.ws_col;
+
+    for (i = 0; i < shown; i++)
+        if (strlen(c->names[i]) + 2 > widest)
+            widest = strlen(c->names[i]) + 2;
+    columns = width / widest ? width / widest : 1;
+
+    fputc('\n', stdout);
+    for (i = 0; i < shown; i++) {
+        if ((i + 1) % columns == 0 || i + 1 == shown)
+            fprintf(stdout, "%s\n", c->names[i]);
+        else
+            fprintf(stdout, "%-*s", (int) widest, c->names[i]);
+    }
+    if (shown < c->count)
+        fprintf(stdout, "... and %zu more\n", c->count - shown);
+
+    if (show_prompt != NULL)
+        show_prompt();
+}
+
+static void complete(void) {
+    size_t start = wordStart(), wordLength = length - start, baseLength;
+    char word[EDITOR_LINE_SIZE];
+    const char *slash;
+    candidates c = {NULL, 0, 0};
+
+    memcpy(word, text + start, wordLength);
+    word[wordLength] = 0;
+    slash = strrchr(word, '/');
+    baseLength = slash ? wordLength - (slash + 1 - word) : wordLength;
+
+    if (commandPosition(start) && slash == NULL)
+        commandCandidates(&c, word, wordLength);
+    else
+        fileCandidates(&c, word);
+    sortUnique(&c);
+
+    if (c.count == 0)
+        bell();
+    else if (c.count == 1) {
+        const char *name = c.names[0];
+        size_t nameLength = strlen(name);
+
+        insert(name + baseLength, nameLength - baseLength);
+        if (name[nameLength - 1] != '/')
+            insert(" ", 1);
+    } else {
+        size_t common = commonPrefix(&c);
+
+        /* extend to what all of them share, list them on the second Tab */
+        if (common > baseLength)
+            insert(c.names[0] + baseLength, common - baseLength);
+        else if (tabbed)
+            listCandidates(&c);
+        else {
+            tabbed = 1;
+            bell();
+        }
+    }
+
+    freeCandidates(&c);
+}
+
+int editorKey(char key) {
+    unsigned char c = (unsigned char) key;
+
+    if (escape == 1) {
+        escape = (c == '[' || c == 'O') ? 2 : 0;
+        return 0;
+    }
+    if (escape == 2) {
+        if (c >= 0x40 && c <= 0x7e)
+            escape = 0;
+        return 0;
+    }
+
+    if (c != '\t')
+        tabbed = 0;
+
+    switch (c) {
+        case '\n':
+        case '\r':
+            fputc('\n', stdout);
+            fflush(stdout);
+            return EDITOR_LINE;
+        case 0x04:      /* ctrl-D */
+            return length == 0 ? EDITOR_EOF : 0;
+        case 0x7f:
+        case '\b':
+            eraseChar();
+            break;
+        case 0x15:      /* ctrl-U */
+            while (length > 0)
+                eraseChar();
+            break;
+        case 0x17:      /* ctrl-W */
+            eraseWord();
+            break;
+        case 0x1b:
+            escape = 1;
+            break;
+        case '\t':
+            complete();
+            break;
+        default:
+            if (c >= 0x20)
+                insert(&key, 1);
+            break;
+    }
+
+    fflush(stdout);
+    return 0;
+}
@@ -0,0 +1,38 @@
+//
+// Line editing at a terminal prompt: keys are read raw (no echo, no canonical mode, signals still on) while
+// a line is typed, the terminal goes back to its own mode before the line runs. Tab completes command names
+// from the PATH index (see pathIndex.h) and the builtins, file names from the directory being typed.
+//
+
+#ifndef LAB6_LINEEDITOR_H
+#define LAB6_LINEEDITOR_H
+
+#include <stddef.h>
+
+#define EDITOR_LINE 1          /* Enter finished the line */
+#define EDITOR_EOF (-1)        /* ctrl-D on an empty line */
+
+/* fd is the terminal. builtins is a NULL terminated list completed along with PATH */
+/* prompt prints the prompt again after completions were listed under the line */
+/* Returns 0 on success, -1 when fd is not a terminal */
+int editorInit(int fd, const char *const *builtins, void (*prompt)(void));
+
+/* Raw mode and an empty line */
+void editorStart(void);
+
+/* The terminal mode the shell started with, for the commands (and at exit) */
+void editorStop(void);
+
+/* 1 between editorStart and editorStop */
+int editorActive(void);
+
+/* Handles one typed byte. Returns EDITOR_LINE, EDITOR_EOF or 0 */
+int editorKey(char key);
+
+/* Copies the finished line with its newline into line */
+void editorLine(char *line, size_t size);
+
+/* Prints the line typed so far again, after something else was printed over the prompt */
+void editorRedraw(void);
+
+#endif //LAB6_LINEEDITOR_H
@@ -0,0 +1,144 @@
+#define _GNU_SOURCE
+#include "memstat.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <malloc.h>
+
+/* in front of every block; the union keeps the payload aligned like malloc's */
+typedef union memHeader {
+    struct {
+        size_t size;
+        int subsystem;
+    } info;
+    long double align_ld;
+    long long align_ll;
+    void *align_ptr;
+} memHeader;
+
+typedef struct memCounter {
+    size_t liveBytes;
+    size_t liveBlocks;
+    size_t peakBytes;
+    unsigned long allocs;
+    unsigned long frees;
+} memCounter;
+
+static memCounter counters[MEM_SUBSYSTEMS];
+
+static const char *subsystem_names[MEM_SUBSYSTEMS] = {"parser", "jobs", "lines", "stats", "topology", "events", "history", "commands", "variables"};
+
+/* relaxed atomics: the parser may allocate from several threads (parseCmdLinesR), */
+/* the counters only need to add up, not to order anything */
+static void *account(memHeader *h, int subsystem, size_t size) {
+    memCounter *c = &counters[subsystem];
+    size_t live, peak;
+
+    if (h == NULL)
+        return NULL;
+
+    h->info.size = size;
+    h->info.subsystem = subsystem;
+
+    live = __atomic_add_fetch(&c->liveBytes, size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&c->liveBlocks, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&c->allocs, 1, __ATOMIC_RELAXED);
+
+    peak = __atomic_load_n(&c->peakBytes, __ATOMIC_RELAXED);
+    while (live > peak && !__atomic_compare_exchange_n(&c->peakBytes, &peak, live, 1, __ATOMIC_RELAXED,
+                                                       __ATOMIC_RELAXED));
+
+    return h + 1;
+}
+
+static void release(memHeader *h) {
+    memCounter *c = &counters[h->info.subsystem];
+
+    __atomic_sub_fetch(&c->liveBytes, h->info.size, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&c->liveBlocks, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&c->frees, 1, __ATOMIC_RELAXED);
+}
+
+void *memAlloc(int subsystem, size_t size) {
+    return account(malloc(sizeof(memHeader) + size), subsystem, size);
+}
+
+void *memCalloc(int subsystem, size_t count, size_t size) {
+    return account(calloc(1, sizeof(memHeader) + count * size), subsystem, count * size);
+}
+
+void *memRealloc(int subsystem, void *ptr, size_t size) {
+    memHeader *h;
+
+    if (ptr == NULL)
+        return memAlloc(subsystem, size);
+
+    h = (memHeader *) ptr - 1;
+    release(h);
+    /* a failed realloc leaves the old block alive and accounted */
+    if ((ptr = realloc(h, sizeof(memHeader) + size)) == NULL) {
+        account(h, h->info.subsystem, h->info.size);
+        return NULL;
+    }
+    return account(ptr, subsystem, size);
+}
+
+char *memStrdup(int subsystem, const char *str) {
+    size_t length = strlen(str) + 1;
+    char *copy = memAlloc(subsystem, length);
+
+    if (copy != NULL)
+        memcpy(copy, str, length);
+    return copy;
+}
+
+void memFree(void *ptr) {
+    memHeader *h;
+
+    if (ptr == NULL)
+        return;
+
+    h = (memHeader *) ptr - 1;
+    release(h);
+    free(h);
+}
+
+static long residentKb(void) {
+    char line[128];
+    long kb = -1;
+    FILE *status = fopen("/proc/self/status", "r");
+
+    if (status == NULL)
+        return -1;
+
+    while (fgets(line, sizeof(line), status) != NULL)
+        if (sscanf(line, "VmRSS: %ld kB", &kb) == 1)
+            break;
+
+    fclose(status);
+    return kb;
+}
+
+void printMemStats(void) {
+    memCounter total;
+    struct mallinfo2 heap = mallinfo2();
+    int i;
+
+    memset(&total, 0, sizeof(total));
+
+    printf("%-10s %12s %10s %12s %12s %12s\n", "SUBSYSTEM", "LIVE BYTES", "BLOCKS", "PEAK BYTES", "ALLOCS", "FREES");
+    for (i = 0; i < MEM_SUBSYSTEMS; i++) {
+        memCounter *c = &counters[i];
+
+        printf("%-10s %12zu %10zu %12zu %12lu %12lu\n", subsystem_names[i], c->liveBytes, c->liveBlocks,
+               c->peakBytes, c->allocs, c->frees);
+        total.liveBytes += c->liveBytes;
+        total.liveBlocks += c->liveBlocks;
+        total.allocs += c->allocs;
+        total.frees += c->frees;
+    }
+    printf("%-10s %12zu %10zu %12s %12lu %12lu\n", "total", total.liveBytes, total.liveBlocks, "",
+           total.allocs, total.frees);
+
+    printf("heap in use %zu bytes, free in heap %zu bytes, rss %ld kB\n", heap.uordblks, heap.fordblks, residentKb());
+}
@@ -0,0 +1,35 @@
+//
+// Counted allocations: every block carries a small header naming its subsystem, so the memstat builtin
+// can report live bytes and allocation counts per subsystem of the shell. Safe to call from any thread.
+//
+
+#ifndef LAB6_MEMSTAT_H
+#define LAB6_MEMSTAT_H
+
+#include <stddef.h>
+
+enum memSubsystem {
+    MEM_PARSER,     /* parsed command lines, arguments, redirections and here-document bodies */
+    MEM_JOBS,       /* process table: jobs, processes, limit sets and launch scratch */
+    MEM_LINES,      /* expansion arenas and substitution texts */
+    MEM_STATS,      /* per-command histograms */
+    MEM_TOPOLOGY,   /* cpu cache topology */
+    MEM_EVENTS,     /* event loop watches */
+    MEM_HISTORY,    /* history index (the lines themselves are in the mapped ring) */
+    MEM_COMMANDS,   /* executables of PATH and completion candidates */
+    MEM_VARIABLES,  /* shell variables and the packed environment of exec */
+    MEM_SUBSYSTEMS
+};
+
+void *memAlloc(int subsystem, size_t size);
+void *memCalloc(int subsystem, size_t count, size_t size);
+void *memRealloc(int subsystem, void *ptr, size_t size);
+char *memStrdup(int subsystem, const char *str);
+
+/* Frees a block from any of the functions above, NULL is ignored */
+void memFree(void *ptr);
+
+/* Prints live bytes, live blocks, peak and allocation counts per subsystem, and the process RSS */
+void printMemStats(void);
+
+#endif //LAB6_MEMSTAT_H
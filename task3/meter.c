@@ -0,0 +1,205 @@
+#define _GNU_SOURCE
+#include "meter.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#ifndef SYS_close_range
+#define SYS_close_range 436
+#endif
+
+#define METER_CHUNK (1 << 20)
+#define METER_COPY_SIZE (64 * 1024)
+
+static unsigned long long nowNs(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int isMeterStage(cmdLine *stage) {
+    return stage->argCount == 1 && strcmp(stage->arguments[0], METER_STAGE) == 0;
+}
+
+cmdLine *meterInsert(cmdLine *command) {
+    cmdLine *stage, *meter;
+    int idx = 0;
+
+    for (stage = command; stage->next != NULL; stage = meter->next) {
+        if (isMeterStage(stage) || isMeterStage(stage->next)) {
+            meter = stage;
+            continue;
+        }
+        meter = parseCmdLines(METER_STAGE);
+        meter->next = stage->next;
+        stage->next = meter;
+    }
+
+    for (stage = command; stage != NULL; stage = stage->next)
+        stage->idx = idx++;
+
+    return command;
+}
+
+meterStats *meterCreate(cmdLine *command, int *count) {
+    meterStats *stats;
+    cmdLine *stage;
+
+    *count = 0;
+    for (stage = command; stage != NULL; stage = stage->next)
+        if (isMeterStage(stage))
+            (*count)++;
+
+    if (*count == 0)
+        return NULL;
+
+    stats = mmap(NULL, *count * sizeof(meterStats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats == MAP_FAILED) {
+        perror("meter: mmap failed");
+        *count = 0;
+        return NULL;
+    }
+
+    return stats;
+}
+
+void meterFree(meterStats *stats, int count) {
+    if (stats != NULL)
+        munmap(stats, count * sizeof(meterStats));
+}
+
+int meterSlot(cmdLine *command, cmdLine *stage) {
+    int slot = 0;
+
+    for (; command != stage; command = command->next)
+        if (isMeterStage(command))
+            slot++;
+
+    return slot;
+}
+
+/* terminals and the like can't be spliced: plain read/write, timing each side */
+static void meterCopy(meterStats *stats) {
+    char *buffer = malloc(METER_COPY_SIZE);
+    unsigned long long t;
+    ssize_t n, written;
+
+    while (1) {
+        t = nowNs();
+        n = read(STDIN_FILENO, buffer, METER_COPY_SIZE);
+        stats->upstreamWaitNs += nowNs() - t;
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+
+        for (written = 0; written < n;) {
+            ssize_t w;
+
+            t = nowNs();
+            w = write(STDOUT_FILENO, buffer + written, n - written);
+            stats->downstreamWaitNs += nowNs() - t;
+            if (w == -1 && errno == EINTR)
+                continue;
+            if (w <= 0) {
+                free(buffer);
+                return;
+            }
+            written += w;
+        }
+        stats->bytes += n;
+    }
+
+    free(buffer);
+}
+
+/* blocks on whichever side held up the last splice and charges the time to it */
+static void meterWait(meterStats *stats) {
+    struct pollfd in = {STDIN_FILENO, POLLIN, 0}, out = {STDOUT_FILENO, POLLOUT, 0};
+    unsigned long long t = nowNs();
+
+    if (poll(&in, 1, 0) == 0) {
+        poll(&in, 1, -1);
+        stats->upstreamWaitNs += nowNs() - t;
+    } else {
+        poll(&out, 1, -1);
+        stats->downstreamWaitNs += nowNs() - t;
+    }
+}
+
+void meterRun(meterStats *stats) {
+    ssize_t n;
+
+    /* no exec here: the pipe ends of the other stages would stay open and hold back their EOF */
+    if (syscall(SYS_close_range, 3, ~0U, 0) == -1) {
+        long fd, max = sysconf(_SC_OPEN_MAX);
+        for (fd = 3; fd < max && fd < 65536; fd++)
+            close(fd);
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    stats->startNs = nowNs();
+
+    while (1) {
+        n = splice(STDIN_FILENO, NULL, STDOUT_FILENO, NULL, METER_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            stats->bytes += n;
+            continue;
+        }
+        if (n == 0)
+            break;
+
+        if (errno == EAGAIN)
+            meterWait(stats);
+        else if (errno == EINVAL && stats->bytes == 0) {
+            meterCopy(stats);
+            break;
+        } else if (errno != EINTR)
+            break;
+    }
+
+    stats->endNs = nowNs();
+    _exit(EXIT_SUCCESS);
+}
+
+static const char *stageName(cmdLine *stage, const char *none) {
+    return stage != NULL && stage->argCount > 0 ? stage->arguments[0] : none;
+}
+
+void meterReport(const meterStats *stats, int count, cmdLine *command) {
+    cmdLine *prev = NULL, *stage;
+    int slot = 0;
+
+    fflush(stdout);
+
+    for (stage = command; stage != NULL && slot < count; prev = stage, stage = stage->next) {
+        const meterStats *m;
+        const char *from, *to;
+        double seconds;
+
+        if (!isMeterStage(stage))
+            continue;
+
+        from = stageName(prev, stage->inputRedirect ? stage->inputRedirect : "stdin");
+        to = stageName(stage->next, stage->outputRedirect ? stage->outputRedirect : "stdout");
+
+        m = &stats[slot++];
+        if (m->endNs == 0)
+            continue;   /* never started or killed */
+
+        seconds = (m->endNs - m->startNs) / 1e9;
+        fprintf(stderr, "meter: %s -> %s: %llu bytes in %.3f s (%.1f MB/s), waited %.0f%% for %s, %.0f%% for %s\n",
+                from, to, m->bytes, seconds, seconds > 0 ? m->bytes / seconds / 1e6 : 0.0,
+                seconds > 0 ? 100 * m->upstreamWaitNs / 1e9 / seconds : 0.0, from,
+                seconds > 0 ? 100 * m->downstreamWaitNs / 1e9 / seconds : 0.0, to);
+    }
+}
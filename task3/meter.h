@@ -0,0 +1,39 @@
+//
+// Throughput meter: a `meter` stage (or `set meter on` between every pair of stages) relays its stdin
+// to its stdout with splice in a forked shell process, no exec, counting bytes and time blocked on each side.
+//
+
+#ifndef LAB6_METER_H
+#define LAB6_METER_H
+
+#include "LineParser.h"
+
+#define METER_STAGE "meter"
+
+/* written by the relay in a MAP_SHARED page, read by the shell once the job is done */
+typedef struct meterStats {
+    unsigned long long bytes;
+    unsigned long long startNs, endNs;
+    unsigned long long upstreamWaitNs;      /* nothing to read: the stage before is slower */
+    unsigned long long downstreamWaitNs;    /* output pipe full: the stage after is slower (backpressure) */
+} meterStats;
+
+int isMeterStage(cmdLine *stage);
+
+/* Inserts a meter stage between every two stages of the chain. Returns the chain */
+cmdLine *meterInsert(cmdLine *command);
+
+/* Maps zeroed shared stats for the meter stages of command. Returns NULL when there are none */
+meterStats *meterCreate(cmdLine *command, int *count);
+void meterFree(meterStats *stats, int count);
+
+/* Slot in the stats of the meter stage `stage` */
+int meterSlot(cmdLine *command, cmdLine *stage);
+
+/* Relays stdin to stdout in the forked child until EOF and exits it */
+void meterRun(meterStats *stats);
+
+/* Prints one line per meter of the finished chain to stderr */
+void meterReport(const meterStats *stats, int count, cmdLine *command);
+
+#endif //LAB6_METER_H
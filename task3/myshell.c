@@ -1,9 +1,24 @@
 
 #include "pipeHelper.h"
+#include "launcher.h"
+#include "eventLoop.h"
+#include "options.h"
+#include "topology.h"
+#include "expand.h"
+#include "trace.h"
+#include "stats.h"
+#include "memstat.h"
+#include "scriptReader.h"
+#include "history.h"
+#include "pathIndex.h"
+#include "lineEditor.h"
+#include "variables.h"
+#include "wildcard.h"
 #include <linux/limits.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <signal.h>
 #include <errno.h>
@@ -13,102 +28,687 @@
 
 
 #define BUFFER_SIZE 2048
-#define TERMINATED  -1
-#define RUNNING 1
-#define SUSPENDED 0
+
+extern char **environ;
 
 
 #define STDIN 0
 #define STDOUT 1
 
-#define READ_FLAGS (O_RDONLY)
-#define CREATE_FLAGS (O_WRONLY | O_CREAT | O_TRUNC)
-#define APPEND_FLAGS (O_WRONLY | O_CREAT | O_APPEND)
-#define READ_MODES (S_IRUSR | S_IRGRP | S_IROTH)
-#define CREATE_MODES (S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH)
 
+/* Function dec */
 
-typedef struct process {
-    cmdLine *cmd;
-    pid_t pid;
-    int status;
-    struct process *next;
+void displayPrompt();
 
-} process;
+/* Returns -1 when command is not a builtin, otherwise its exit code */
+int execSpecialCommand(cmdLine *command, int debug);
 
-/* Function dec */
+int runLine(char *buf, int debug);
 
-void displayPrompt();
+/* Runs the pipelines of a list in order. Returns the exit code of the last one that ran */
+int dispatchLine(cmdLine *line, int debug);
 
-void printDebug(char *buffer, int pid, int debug);
+/* Same for a raw list holding expansions, see runLine */
+int dispatchExpanded(char *source, cmdLine *masked, int debug);
 
-int execSpecialCommand(cmdLine *command, int debug);
+void quitShell(int status);
 
-void execute(cmdLine *command, int debug, int counter);
 
-int cmdCounter(cmdLine *command, int debug);
+static char input[BUFFER_SIZE];
+static size_t input_len = 0;
+static int stdin_polled = 1;    /* 0 when stdin can't be watched by epoll (regular files) */
+static int at_prompt = 0;
+static int debug = 0;
+static arena line_arena;       /* expanded form of the line being run */
+static int watching = 0;       /* showprocs -w refreshing until a key, SIGINT or the last process exits */
 
-process *global_process_list;
+/* a parsed line waiting for the bodies of its << here-documents */
+static cmdLine *pending_command = NULL;
+static cmdLine *pending_stage = NULL;
+static char *pending_source = NULL;     /* the raw line when pending_command is its masked parse */
+static char *here_body = NULL;
+static size_t here_length = 0, here_capacity = 0;
 
+/* completed by the line editor along with the commands of PATH */
+static const char *const builtin_names[] = {
+        "cd", "quit", "nap", "showprocs", "stop", "set", "topology", "stats", "memstat", "history", "trace", "signal",
+        "export", "unset", NULL
+};
 
-int main(int argc, char const *argv[]) {
 
-    int debug = 0;
-    int i;
-    int counter = 1;
+/* ----- Here-documents ----- */
+static cmdLine *nextHereStage(cmdLine *stage) {
+    while (stage != NULL && (stage->hereDelimiter == NULL || stage->hereDocument != NULL))
+        stage = stage->next;
+    return stage;
+}
+
+static void appendHereBody(const char *text, size_t len) {
+    if (here_length + len + 1 > here_capacity) {
+        here_capacity = (here_length + len + 1) * 2;
+        here_body = memRealloc(MEM_PARSER, here_body, here_capacity);
+    }
+    memcpy(here_body + here_length, text, len);
+    here_length += len;
+    here_body[here_length] = 0;
+}
+
+/* hands the collected body to the waiting stage. Returns 1 while another stage still needs one */
+static int completeHereStage(void) {
+    appendHereBody("", 0);
+    setHereDocument(pending_stage, here_body);
+    here_body = NULL;
+    here_length = here_capacity = 0;
+
+    if ((pending_stage = nextHereStage(pending_stage->next)) != NULL)
+        return 1;
+
+    cmdLine *line = pending_command;
+    char *source = pending_source;
+    pending_command = NULL;
+    pending_source = NULL;
+    if (source != NULL)
+        dispatchExpanded(source, line, debug);
+    else
+        dispatchLine(line, debug);
+    return 0;
+}
+
+/* Returns 1 while the pending line needs more input */
+static int collectHereDocument(const char *text) {
+    size_t len = strlen(text);
+    size_t content = (len > 0 && text[len - 1] == '\n') ? len - 1 : len;
+
+    if (content == strlen(pending_stage->hereDelimiter) && strncmp(text, pending_stage->hereDelimiter, content) == 0)
+        return completeHereStage();
 
-    global_process_list = NULL;
+    appendHereBody(text, len);
+    return 1;
+}
+
+
+/* ----- Input ----- */
+/* end of input: an unfinished line still runs, here-documents end at end-of-file */
+static void endOfInput(void) {
+    if (pending_command != NULL) {
+        fprintf(stderr, "here-document delimited by end-of-file (wanted `%s')\n", pending_stage->hereDelimiter);
+        while (completeHereStage());
+    }
+    quitShell(EXIT_SUCCESS);
+}
+
+/* !! and !prefix as the first word of a typed line become the newest matching line, then the line is kept */
+/* Returns -1 when there is no such line or the result does not fit */
+static int expandHistory(char *line, size_t size) {
+    char *word = line + strspn(line, " \t"), *rest, expanded[BUFFER_SIZE];
+    const char *found;
+
+    if (word[0] == '!' && word[1] && strchr(" \t\n", word[1]) == NULL) {
+        rest = word + 1 + strcspn(word + 1, " \t\n");
+
+        if (word[1] == '!' && rest == word + 2)
+            found = historyFind("", 0);
+        else
+            found = historyFind(word + 1, rest - word - 1);
+
+        if (found == NULL) {
+            fprintf(stderr, "%.*s: event not found\n", (int) (rest - word), word);
+            return -1;
+        }
+        if ((size_t) snprintf(expanded, sizeof(expanded), "%s%s", found, rest) >= size) {
+            fprintf(stderr, "%.*s: line too long\n", (int) (rest - word), word);
+            return -1;
+        }
+
+        strcpy(line, expanded);
+        fputs(line, stdout);
+    }
+
+    historyAdd(line);
+    return 0;
+}
+
+/* a typed line runs, or is a body line of the here-document waiting for it */
+/* Returns 1 when more here-document lines are wanted */
+static int typedLine(char *line, size_t size) {
+    if (pending_command != NULL)
+        return collectHereDocument(line);
+    return expandHistory(line, size) == 0 && runLine(line, debug);
+}
+
+static void handleInput(int fd, uint32_t events, void *arg) {
+    ssize_t n = read(fd, input + input_len, BUFFER_SIZE - 1 - input_len);
+    char *newline;
+
+    if (n == -1 && (errno == EINTR || errno == EAGAIN))
+        return;
+
+    if (n <= 0) {   /* end of input behaves like quit */
+        if (input_len > 0) {
+            input[input_len] = 0;
+            input_len = 0;
+            typedLine(input, sizeof(input));
+        }
+        endOfInput();
+    }
+
+    input_len += n;
+    at_prompt = 0;
+
+    /* no reading while a job owns the terminal (a parked fd would still report hangups) */
+    if (stdin_polled)
+        loopRemoveFd(fd);
+
+    while ((newline = memchr(input, '\n', input_len)) != NULL || input_len == BUFFER_SIZE - 1) {
+        char line[BUFFER_SIZE];
+        size_t len = newline ? (size_t) (newline - input) + 1 : input_len;
+
+        memcpy(line, input, len);
+        line[len] = 0;
+        input_len -= len;
+        memmove(input, input + len, input_len);
+
+        if (typedLine(line, sizeof(line))) {
+            fprintf(stdout, "> ");
+            fflush(stdout);
+            continue;
+        }
+
+        fprintf(stdout, "%c", '\n');
+        notifyJobs();
+        displayPrompt();
+    }
+
+    if (stdin_polled)
+        loopAddFd(fd, EPOLLIN, handleInput, NULL);
+    at_prompt = 1;
+}
+
+/* a terminal: keys go to the line editor, the commands of a finished line get the terminal's own mode */
+static void handleKeys(int fd, uint32_t events, void *arg) {
+    char keys[BUFFER_SIZE], line[BUFFER_SIZE];
+    ssize_t n = read(fd, keys, sizeof(keys)), i;
+
+    if (n == -1 && (errno == EINTR || errno == EAGAIN))
+        return;
+
+    if (n <= 0) {
+        editorStop();
+        endOfInput();
+    }
+
+    at_prompt = 0;
+    loopRemoveFd(fd);
+
+    for (i = 0; i < n; i++) {
+        int key = editorKey(keys[i]), more;
+
+        if (key == EDITOR_EOF) {
+            fprintf(stdout, "\n");
+            editorStop();
+            endOfInput();
+        }
+        if (key != EDITOR_LINE)
+            continue;
+
+        editorLine(line, sizeof(line));
+        editorStop();
+        more = typedLine(line, sizeof(line));
+        editorStart();
+
+        if (more) {
+            fprintf(stdout, "> ");
+            fflush(stdout);
+            continue;
+        }
+
+        fprintf(stdout, "%c", '\n');
+        notifyJobs();
+        displayPrompt();
+    }
+
+    loopAddFd(fd, EPOLLIN, handleKeys, NULL);
+    at_prompt = 1;
+}
+
+/* ----- Script mode ----- */
+static void runScriptLine(scriptLine *line) {
+    char *start, *end;
+
+    if (line->command != NULL) {
+        dispatchLine(line->command, debug);
+        return;
+    }
+
+    /* a raw line and its here-document lines take the same path as typed lines */
+    for (start = line->raw; *start; start = end) {
+        end = strchr(start, '\n');
+        end = end ? end + 1 : start + strlen(start);
+
+        char saved = *end;
+        *end = 0;
+        if (pending_command != NULL)
+            collectHereDocument(start);
+        else
+            runLine(start, debug);
+        *end = saved;
+    }
+    if (!line->rawMapped)
+        memFree(line->raw);
+}
+
+static void handleScript(int fd, uint32_t events, void *arg) {
+    scriptLine line;
+    int next;
+
+    /* a foreground job waits in the loop too, the next line must not start meanwhile */
+    loopRemoveFd(fd);
+
+    while ((next = scriptNext(&line)) == 1) {
+        runScriptLine(&line);
+        notifyJobs();
+        fflush(stdout);
+    }
+
+    if (next == -1)
+        endOfInput();
+
+    loopAddFd(fd, EPOLLIN, handleScript, NULL);
+}
+
+static void handleSignal(int signo) {
+    TRACE(TRACE_SIGNAL, -1, -1, signo, "received");
+
+    if (signo == SIGCHLD) {
+        updateProcessList();
+        return;
+    }
+
+    if (watching) {
+        watching = 0;
+        return;
+    }
+
+    /* the terminal delivers these to the foreground job itself, forward them when nobody has one */
+    if (foreground_job != NULL) {
+        if (!isatty(STDIN_FILENO)) {
+            TRACE(TRACE_SIGNAL, -foreground_job->pgid, foreground_job->pgid, signo, "forward");
+            killpg(foreground_job->pgid, signo);
+        }
+        return;
+    }
+
+    if (signo == SIGINT && at_prompt) {
+        fprintf(stdout, "\n");
+        editorStart();
+        displayPrompt();
+    }
+}
+
+
+int main(int argc, char const *argv[]) {
+
+    const char *script = NULL;
+    char history_path[PATH_MAX];
+    int i, script_fd;
 
     for (i = 1; i < argc; i++) {
 
         if (strcmp("-d", argv[i]) == 0)
             debug = 1;
+        else
+            script = argv[i];
     }
-    char buf[BUFFER_SIZE];
 
-    while (1) {
+    traceInit();
+
+    if (loopInit() == -1)
+        exit(EXIT_FAILURE);
+    loopSetSignalHandler(handleSignal);
+    launcherInit(isatty(STDIN_FILENO));
+
+    /* jobs exec from it too, a script needs it as much as a terminal */
+    varsInit(environ);
+    pathIndexInit(varGet("PATH", 4));
+
+    /* the reader thread starts after loopInit blocked the shell's signals, it inherits the mask */
+    if (script != NULL) {
+        if ((script_fd = scriptOpen(script)) == -1 || loopAddFd(script_fd, EPOLLIN, handleScript, NULL) == -1)
+            exit(EXIT_FAILURE);
+    }
 
+    else if (isatty(STDIN_FILENO) && editorInit(STDIN_FILENO, builtin_names, displayPrompt) == 0) {
+        if (loopAddFd(STDIN_FILENO, EPOLLIN, handleKeys, NULL) == -1) {
+            perror("can't watch standard input");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    else if (loopAddFd(STDIN_FILENO, EPOLLIN, handleInput, NULL) == -1) {
+        if (errno != EPERM) {
+            perror("can't watch standard input");
+            exit(EXIT_FAILURE);
+        }
+        stdin_polled = 0;
+    }
+
+    /* only people typing at a terminal make history, not scripts or piped input */
+    if (script == NULL && isatty(STDIN_FILENO) && historyPath(history_path, sizeof(history_path)) == 0)
+        historyOpen(history_path);
+
+    if (script == NULL) {
+        editorStart();
         displayPrompt();
-        fgets(buf, BUFFER_SIZE, stdin);
-        cmdLine *line = parseCmdLines(buf);
-        counter = cmdCounter(line, debug);
-//        fprintf(stdout, "%d\n", counter);
-        execute(line, debug, counter);
-        fprintf(stdout, "%c", '\n');
+        at_prompt = 1;
+    }
+
+    while (1) {
+
+        if (!stdin_polled)
+            handleInput(STDIN_FILENO, EPOLLIN, NULL);
+
+        /* idle shells sleep in epoll_wait until input, a script line, a signal, a timer or a pidfd wakes them */
+        if (loopRunOnce(stdin_polled ? -1 : 0) == -1)
+            quitShell(EXIT_FAILURE);
 
+        if (at_prompt && pendingNotifications()) {
+            fprintf(stdout, "\n");
+            notifyJobs();
+            displayPrompt();
+        }
     }
 
     return 0;
 }
 
-/* ----- Printing ----- */
-void printDebug(char *buffer, int pid, int debug) {
-    if (debug == 1) {
-        if (pid != -1)
-            fprintf(stderr, "(%s: %d)\n", buffer, pid);
+/* Returns 1 when the line waits for here-document bodies from the next input lines */
+int runLine(char *buf, int debug) {
+    cmdLine *line;
+    char *source = NULL;
+
+    /* a list with expansions is parsed with its substitutions masked, that is enough for its here-documents. */
+    /* Its pipelines are expanded one at a time as they run, after the ones before changed what they see */
+    if (needsExpansion(buf)) {
+        source = memStrdup(MEM_LINES, buf);
+        arenaReset(&line_arena);
+        arenaAppend(&line_arena, buf, strlen(buf) + 1);
+        maskSubstitutions(line_arena.data);
+        buf = line_arena.data;
+    }
+
+    if ((line = parseCmdLines(buf)) == NULL) {
+        memFree(source);
+        return 0;
+    }
+
+    if ((pending_stage = nextHereStage(line)) != NULL) {
+        pending_command = line;
+        pending_source = source;
+        return 1;
+    }
+
+    if (source != NULL)
+        dispatchExpanded(source, line, debug);
+    else
+        dispatchLine(line, debug);
+    return 0;
+}
+
+/* Expands and parses length bytes of text, one pipeline, handing it the here-document bodies read for the */
+/* same pipeline of the masked parse. Returns 0 with *line NULL when nothing is left to run, -1 on error */
+static int expandPipeline(const char *text, size_t length, cmdLine *masked, cmdLine **line, int debug) {
+    fdSubstitutions subs;
+    cmdLine *stage;
+    long expanded;
+    char *pipeline;
+
+    arenaReset(&line_arena);
+    pipeline = memAlloc(MEM_LINES, length + 1);
+    memcpy(pipeline, text, length);
+    pipeline[length] = 0;
+    expanded = expandLine(pipeline, &line_arena, &subs, debug);
+    memFree(pipeline);
+    if (expanded == -1)
+        return -1;
+
+    if ((*line = parseCmdLines(line_arena.data + expanded)) == NULL) {
+        dropSubstitutions(&subs);
+        return 0;
+    }
+    attachSubstitutions(*line, &subs);
+    restoreLiterals(*line);
+
+    /* expansions can't add or remove a <<, the bodies come in the order of the stages */
+    for (stage = nextHereStage(*line); stage != NULL; stage = nextHereStage(stage->next)) {
+        while (masked != NULL && masked->hereDelimiter == NULL)
+            masked = masked->next;
+        if (masked == NULL)
+            break;
+        setHereDocument(stage, (char *) masked->hereDocument);
+        masked->hereDocument = NULL;
+        masked = masked->next;
+    }
+    return 0;
+}
+
+static int dispatchPipeline(cmdLine *line, int debug) {
+    int counter = cmdCounter(line, debug);
+    int status;
+
+    if (line->argCount == 0) {  /* only redirections */
+        freeCmdLines(line);
+        return 0;
+    }
+
+    /* at run time, not parse time: the lines of a script were parsed ahead and may come from its cache */
+    expandWildcards(line);
+
+//        fprintf(stdout, "%d\n", counter);
+    if ((status = execSpecialCommand(line, debug)) == -1)
+        status = exitCode(execute(line, debug, counter));
+    return status;
+}
+
+int dispatchLine(cmdLine *line, int debug) {
+    cmdLine *rest;
+    char connector = LIST_SEQ;
+    int status = 0;
+
+    /* one parse for the whole list: && and || only decide which of the parsed pipelines get launched */
+    for (; line != NULL; line = rest) {
+        int runs = listRuns(connector, status);
+
+        rest = splitPipeline(line, &connector);
+        if (runs)
+            status = dispatchPipeline(line, debug);
         else
-            fprintf(stderr, "%s\n", buffer);
+            freeCmdLines(line);
+    }
+
+    return status;
+}
+
+int dispatchExpanded(char *source, cmdLine *masked, int debug) {
+    const char *text, *rest;
+    cmdLine *line, *bodies;
+    char connector = LIST_SEQ, next, skipped;
+    int status = 0;
+    size_t length;
+
+    /* the raw pipelines and the masked ones pair up: masking changes nothing nextPipeline cuts at */
+    for (text = source; text != NULL; text = rest) {
+        rest = nextPipeline(text, &length, &next);
+        if (strspn(text, " \t\n") >= length)     /* empty pipelines add nothing, as in parseCmdLines */
+            continue;
+
+        bodies = masked;
+        masked = masked != NULL ? splitPipeline(masked, &skipped) : NULL;
+
+        if (listRuns(connector, status)) {
+            if (expandPipeline(text, length, bodies, &line, debug) == -1)
+                status = EXIT_FAILURE;
+            else if (line != NULL)
+                status = dispatchPipeline(line, debug);
+        }
+        freeCmdLines(bodies);
+        connector = next;
     }
+
+    freeCmdLines(masked);
+    memFree(source);
+    return status;
 }
 
+void quitShell(int status) {
+    editorStop();
+    scriptClose();
+    historyClose();
+    pathIndexFree();
+    varsFree();
+    fflush(stdout);
+    freeJobList();
+    exit(status);
+}
 
+/* ----- Printing ----- */
 void displayPrompt() {
 
     char path_name[PATH_MAX];
     getcwd(path_name, PATH_MAX);
     fprintf(stdout, "%s>", path_name);
+    editorRedraw();
+    fflush(stdout);
+}
+
+/* ----- Builtins ----- */
+/* PATH changed: the index follows, and so does the shell's own environ, where execvpe finds what the index leaves out */
+static void pathChanged(void) {
+    const char *path = varGet("PATH", 4);
+
+    if (path != NULL)
+        setenv("PATH", path, 1);
+    else
+        unsetenv("PATH");
+    pathIndexInit(path);
+}
+
+static int isAssignment(const char *word) {
+    const char *equals = strchr(word, '=');
+
+    return equals != NULL && varValidName(word, equals - word);
+}
+
+/* NAME=value, or NAME alone when exporting. Returns -1 when NAME is not a valid name */
+static int assignVariable(const char *word, int exported) {
+    const char *equals = strchr(word, '=');
+    size_t length = equals ? (size_t) (equals - word) : strlen(word);
+
+    if (!varValidName(word, length) || (equals == NULL && !exported))
+        return -1;
+
+    if (equals != NULL)
+        varSet(word, length, equals + 1);
+    if (exported)
+        varExport(word, length);
+    if (length == 4 && strncmp(word, "PATH", 4) == 0)
+        pathChanged();
+    return 0;
+}
+
+static int compareStrings(const void *a, const void *b) {
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+static void printExported(void) {
+    char *const *environment = varEnvironment();
+    char **sorted;
+    size_t count = 0, i;
+
+    while (environment[count] != NULL)
+        count++;
+
+    sorted = memAlloc(MEM_VARIABLES, (count + 1) * sizeof(char *));
+    memcpy(sorted, environment, count * sizeof(char *));
+    qsort(sorted, count, sizeof(char *), compareStrings);
+    for (i = 0; i < count; i++)
+        printf("export %s\n", sorted[i]);
+    memFree(sorted);
+}
+
+static void napWakeUp(int timer, uint32_t events, void *arg) {
+    pid_t nap_pid = (pid_t) (intptr_t) arg;
+
+    if (kill(nap_pid, SIGCONT) == -1)
+        perror("kill SIGCONT failed");
+
+    else
+        printf("%d handling SIGCONT\n", nap_pid);
+}
+
+/* one write per frame: the cursor goes home, the table is drawn, the rest of the screen is cleared */
+static void drawProcesses(void) {
+    char *frame = NULL;
+    size_t size = 0;
+    FILE *out = open_memstream(&frame, &size);
+
+    if (out == NULL)
+        return;
+
+    fputs("\033[H", out);
+    if (printProcessList(out) == 0 && !(isatty(STDIN_FILENO) && stdin_polled))
+        watching = 0;
+    fputs("\033[J", out);
+    fclose(out);
+
+    fflush(stdout);
+    write(STDOUT_FILENO, frame, size);
+    free(frame);
+}
+
+static void watchTick(int timer, uint32_t events, void *arg) {
+    drawProcesses();
+}
+
+static void watchKey(int fd, uint32_t events, void *arg) {
+    char discard[BUFFER_SIZE];
+
+    read(fd, discard, sizeof(discard));
+    watching = 0;
+}
+
+/* without a terminal to press a key on, the view ends once nothing runs anymore */
+static void watchProcesses(long intervalMs) {
+    int timer = loopAddTimer(intervalMs, 1, watchTick, NULL);
+    int keys = isatty(STDIN_FILENO) && stdin_polled && loopAddFd(STDIN_FILENO, EPOLLIN, watchKey, NULL) == 0;
+
+    if (timer == -1) {
+        perror("showprocs: timer");
+        return;
+    }
+
+    watching = 1;
+    fputs("\033[2J", stdout);
+    drawProcesses();
+
+    while (watching && loopRunOnce(-1) != -1);
+
+    watching = 0;
+    if (keys)
+        loopRemoveFd(STDIN_FILENO);
+    loopCancelTimer(timer);
 }
 
 int execSpecialCommand(cmdLine *command, int debug) {
-    int special = 0;
+    int status = -1;
     if (strcmp(command->arguments[0], "cd") == 0) {
 
-        special = 1;
+        status = 0;
 
         int val = chdir(command->arguments[1]);
         freeCmdLines(command);
 
         if (val < 0) {
+            status = EXIT_FAILURE;
             perror("ERROR on cd command");
 
             if (debug)
@@ -117,174 +717,222 @@ int execSpecialCommand(cmdLine *command, int debug) {
         }
 
     }
-    return special;
-}
 
+    else if (strcmp(command->arguments[0], "quit") == 0) {
+        freeCmdLines(command);
+        quitShell(EXIT_SUCCESS);
+    }
+
+    else if (strcmp(command->arguments[0], "nap") == 0) {
+
+        status = 0;
 
-void execute(cmdLine *command, int debug, int counter) {
-    pid_t wait_pid;
-    pid_t pid;
-    int **pipes;
-    if (execSpecialCommand(command, debug) == 0) {
-        int waitpid_status;
-        if (strcmp(command->arguments[0], "quit") == 0) {
+        if (command->argCount < 3) {
+            fprintf(stderr, "usage: nap <seconds> <pid>\n");
+            status = EXIT_FAILURE;
             freeCmdLines(command);
-            exit(EXIT_SUCCESS);
+            return status;
         }
-        if (counter > 1) { // if we have few commands, need to create pipe
-            pipes = createPipes(counter - 1);
-            cmdLine *cur_command = command;
-
-            while (cur_command != NULL) {
-
-                if ((pid = fork()) == -1) {
-                    perror("cant fork");
-                    exit(1);
-                } else if (pid == 0) {
-                    /*child*/
-
-                    if (command->inputRedirect) {
-                        int fd_input = open(command->inputRedirect, READ_FLAGS, READ_MODES);
-
-                        if(fd_input == -1){
-                            perror("Failed to open the file given as input...");
-                            return;
-                        }
-
-                        if(dup2(fd_input, STDIN_FILENO) == -1){
-                            perror("Failed to redirect standard input...");
-                            return;
-                        }
-
-                        if(close(fd_input) == -1){
-                            perror("Failed to close the input file...");
-                            return;
-                        }
-
-                    }
-
-                    if (command->outputRedirect) {
-                        int fd_output = open(command->outputRedirect,APPEND_FLAGS, CREATE_MODES);
-
-                        if(fd_output == -1){
-                            perror("Failed to create or append to the file given as input...");
-                            return;
-                        }
-
-                        if(dup2(fd_output, STDOUT_FILENO) == -1){
-                            perror("Failed to redirect standard error...");
-                            return;
-                        }
-                        if(close(fd_output) == -1){
-                            perror("Failed to close the output file...");
-                            return;
-                        }
-                    }
-
-                    //check if there is left command
-                    if (leftPipe(pipes, cur_command) != NULL) {
-                        dup2(pipes[cur_command->idx - 1][0],0);/*replace the read end to our file */
-                        close(pipes[cur_command->idx - 1][0]); /*Close the file descriptor that was duplicated. */
-                    }
-
-                    //check if there is right command
-                    if (rightPipe(pipes, cur_command) != NULL) {
-                        dup2(pipes[cur_command->idx][1], 1); /*replace the write-end to our file */
-                        close(pipes[cur_command->idx][1]); /*Close the file descriptor that was duplicated. */
-
-                    }
-
-                    execvp(cur_command->arguments[0], cur_command->arguments); //execvp only file name
-
-                    exit(1);
-                } else {/*parent code*/
-                    waitpid(pid, &waitpid_status, 0);//
-                    //wait(NULL);
-
-                    if (rightPipe(pipes, cur_command) != NULL) {
-                        close(pipes[cur_command->idx][1]);
-                    }
-
-                    //check if it is the first command - if not close read channel
-                    if (leftPipe(pipes, cur_command) != NULL) {
-                        close(pipes[cur_command->idx - 1][0]);
-                    }
-
-                    //check if it is the last command
-                    if (rightPipe(pipes, cur_command) == NULL) {
-                        releasePipes(pipes, counter - 1);
-
-                    }
-                    cur_command = cur_command->next;
-                }
-            }
+
+        int nap_time = atoi(command->arguments[1]);
+        int nap_pid = atoi(command->arguments[2]);
+        freeCmdLines(command);
+
+        /* the wake up is a timer of the event loop, no helper process sleeps for it */
+        if (kill(nap_pid, SIGTSTP) == -1) {
+            perror("kill SIGTSTP failed");
+            status = EXIT_FAILURE;
         }
-/*    set follow-fork-mode child    */
-/*    set detach-on-fork off        */
-/*    ls | tee | tail -n 2     */
-        else {/*the old shell */
-            pid = fork();
-            if (pid == 0) {
-                if (command->inputRedirect) {
-                    int fd_input = open(command->inputRedirect, READ_FLAGS, READ_MODES);
-
-                    if(fd_input == -1){
-                        perror("Failed to open the file given as input...");
-                        return;
-                    }
-
-                    if(dup2(fd_input, STDIN_FILENO) == -1){
-                        perror("Failed to redirect standard input...");
-                        return;
-                    }
-
-                    if(close(fd_input) == -1){
-                        perror("Failed to close the input file...");
-                        return;
-                    }
-
-                }
-
-                if (command->outputRedirect) {
-                    int fd_output = open(command->outputRedirect,APPEND_FLAGS, CREATE_MODES);
-
-                    if(fd_output == -1){
-                        perror("Failed to create or append to the file given as input...");
-                        return;
-                    }
-
-                    if(dup2(fd_output, STDOUT_FILENO) == -1){
-                        perror("Failed to redirect standard error...");
-                        return;
-                    }
-                    if(close(fd_output) == -1){
-                        perror("Failed to close the output file...");
-                        return;
-                    }
-                }
-                execvp(command->arguments[0], command->arguments); //execvp only file name
-                _exit(0);//if execvp in executed succeed then we will not return to this line in the code, so if failed we will get here anyway
-            }
 
-            wait_pid = 0;
-            if (command->blocking != 0) {
-                waitpid(pid, &waitpid_status, 0);// equivalent to wait(&ProgramId)
+        else {
+            printf("%d handling SIGTSTP:\n", nap_pid);
+            loopAddTimer(nap_time * 1000L, 0, napWakeUp, (void *) (intptr_t) nap_pid);
+        }
+
+    }
+
+    else if (strcmp(command->arguments[0], "showprocs") == 0) {
+
+        status = 0;
+
+        if (command->argCount == 3 && strcmp(command->arguments[1], "-w") == 0 && atof(command->arguments[2]) > 0)
+            watchProcesses((long) (atof(command->arguments[2]) * 1000));
+        else if (command->argCount == 1)
+            printProcessList(stdout);
+        else {
+            fprintf(stderr, "usage: showprocs [-w <seconds>]\n");
+            status = EXIT_FAILURE;
+        }
+        freeCmdLines(command);
+
+    }
+
+    else if (strcmp(command->arguments[0], "stop") == 0) {
+
+        status = 0;
+
+        if (command->argCount < 2) {
+            fprintf(stderr, "usage: stop <pid|lo-hi|%%job|-pgid>...\n");
+            status = EXIT_FAILURE;
+        } else if (signalTargets(SIGINT, command->arguments + 1, command->argCount - 1) > 0)
+            status = EXIT_FAILURE;
+        freeCmdLines(command);
+
+    }
+
+    else if (strcmp(command->arguments[0], "set") == 0) {
+
+        status = 0;
+
+        if (command->argCount == 1)
+            printOptions();
+        else if (command->argCount != 3 || setOption(command->arguments[1], command->arguments[2]) == -1) {
+            fprintf(stderr, "usage: set [<option> on|off]\n");
+            status = EXIT_FAILURE;
+        }
+        freeCmdLines(command);
+
+    }
+
+    else if (strcmp(command->arguments[0], "topology") == 0) {
+
+        status = 0;
+        printTopology();
+        freeCmdLines(command);
+
+    }
+
+    else if (strcmp(command->arguments[0], "stats") == 0) {
+
+        status = 0;
+
+        if (command->argCount == 2 && strcmp(command->arguments[1], "reset") == 0)
+            statsReset();
+        else if (command->argCount == 1)
+            printStats();
+        else {
+            fprintf(stderr, "usage: stats [reset]\n");
+            status = EXIT_FAILURE;
+        }
+        freeCmdLines(command);
+
+    }
+
+    else if (strcmp(command->arguments[0], "memstat") == 0) {
+
+        status = 0;
+        freeCmdLines(command);
+        printMemStats();
+
+    }
+
+    else if (strcmp(command->arguments[0], "history") == 0) {
+
+        status = 0;
+
+        int first = 1;
+        long count = 0;
+
+        if (command->argCount > 2 && strcmp(command->arguments[1], "-n") == 0) {
+            count = atol(command->arguments[2]);
+            first = 3;
+        }
+
+        if (count < 0 || command->argCount > first + 1) {
+            fprintf(stderr, "usage: history [-n <count>] [<text>]\n");
+            status = EXIT_FAILURE;
+        } else
+            printHistory(stdout, count, command->argCount > first ? command->arguments[first] : NULL);
+        freeCmdLines(command);
+
+    }
+
+    else if (strcmp(command->arguments[0], "trace") == 0) {
+
+        status = 0;
+
+        if (command->argCount == 3 && strcmp(command->arguments[1], "dump") == 0) {
+            if (traceDump(command->arguments[2]) == 0)
+                printf("%lu events written to %s\n", traceCount(), command->arguments[2]);
+            else
+                status = EXIT_FAILURE;
+        } else if (command->argCount == 2 && strcmp(command->arguments[1], "clear") == 0)
+            traceClear();
+        else if (command->argCount == 1)
+            printf("tracing %s, %lu events\n", options.trace ? "on" : "off", traceCount());
+        else {
+            fprintf(stderr, "usage: trace [dump <file> | clear]   (set trace on|off)\n");
+            status = EXIT_FAILURE;
+        }
+        freeCmdLines(command);
+
+    }
+
+    else if (strcmp(command->arguments[0], "signal") == 0) {
+
+        status = 0;
+
+        int signo = command->argCount > 1 ? parseSignal(command->arguments[1]) : -1;
+
+        if (command->argCount < 3 || signo == -1) {
+            fprintf(stderr, "usage: signal <SIG> <pid|lo-hi|%%job|-pgid>...\n");
+            status = EXIT_FAILURE;
+        } else if (signalTargets(signo, command->arguments + 2, command->argCount - 2) > 0)
+            status = EXIT_FAILURE;
+        freeCmdLines(command);
+
+    }
+
+    else if (strcmp(command->arguments[0], "export") == 0) {
 
+        status = 0;
 
+        if (command->argCount == 1)
+            printExported();
+
+        for (int i = 1; i < command->argCount; i++) {
+            if (assignVariable(command->arguments[i], 1) == -1) {
+                fprintf(stderr, "export: `%s': not a valid identifier\n", command->arguments[i]);
+                status = EXIT_FAILURE;
             }
+        }
+        freeCmdLines(command);
+
+    }
 
+    else if (strcmp(command->arguments[0], "unset") == 0) {
+
+        status = 0;
+
+        for (int i = 1; i < command->argCount; i++) {
+            const char *name = command->arguments[i];
+
+            if (!varValidName(name, strlen(name))) {
+                fprintf(stderr, "unset: `%s': not a valid identifier\n", name);
+                status = EXIT_FAILURE;
+            } else if (varUnset(name, strlen(name)) && strcmp(name, "PATH") == 0)
+                pathChanged();
         }
+        freeCmdLines(command);
 
     }
 
-}
+    /* a line of NAME=value words sets shell variables, commands see them once exported */
+    else if (isAssignment(command->arguments[0])) {
+
+        status = 0;
+
+        for (int i = 0; i < command->argCount; i++) {
+            if (!isAssignment(command->arguments[i])) {
+                fprintf(stderr, "%s: NAME=value before a command is not supported, export it\n", command->arguments[i]);
+                status = EXIT_FAILURE;
+                break;
+            }
+            assignVariable(command->arguments[i], 0);
+        }
+        freeCmdLines(command);
 
-int cmdCounter(cmdLine *command, int debug) {
-    int counter = 1;
-    cmdLine *cur_command = command;
-    while (cur_command->next) {
-        cur_command = cur_command->next;
-        counter++;
     }
-    return counter;;
-}
\ No newline at end of file
+
+    return status;
+}
@@ -0,0 +1,47 @@
+#include "options.h"
+#include <stdio.h>
+#include <string.h>
+
+shellOptions options = {.fuse = 1, .stats = 1};
+
+static const struct {
+    const char *name;
+    int *flag;
+    const char *description;
+} option_table[] = {
+        {"topology", &options.topology, "place pipeline stages on cache-sharing cpus"},
+        {"fuse",     &options.fuse,     "rewrite cat file | cmd as cmd < file (and similar) before launching"},
+        {"meter",    &options.meter,    "meter the bytes crossing each pipe and report per-stage throughput"},
+        {"trace",    &options.trace,    "record shell events in memory, written by trace dump <file>"},
+        {"stats",    &options.stats,    "keep per-command latency histograms for the stats builtin"},
+        {"perf",     &options.perf,     "count task-clock, context switches, migrations and page faults per stage"},
+};
+
+#define OPTIONS ((int) (sizeof(option_table) / sizeof(option_table[0])))
+
+int setOption(const char *name, const char *value) {
+    int i, on;
+
+    if (strcmp(value, "on") == 0 || strcmp(value, "1") == 0)
+        on = 1;
+    else if (strcmp(value, "off") == 0 || strcmp(value, "0") == 0)
+        on = 0;
+    else
+        return -1;
+
+    for (i = 0; i < OPTIONS; i++)
+        if (strcmp(option_table[i].name, name) == 0) {
+            *option_table[i].flag = on;
+            return 0;
+        }
+
+    return -1;
+}
+
+void printOptions(void) {
+    int i;
+
+    for (i = 0; i < OPTIONS; i++)
+        printf("%-12s%s\t%s\n", option_table[i].name, *option_table[i].flag ? "on" : "off",
+               option_table[i].description);
+}
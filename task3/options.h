@@ -0,0 +1,24 @@
+//
+// Shell switches toggled with the set builtin: `set <name> on|off`, `set` lists them.
+//
+
+#ifndef LAB6_OPTIONS_H
+#define LAB6_OPTIONS_H
+
+typedef struct shellOptions {
+    int topology;           /* pin pipeline stages next to each other by cache topology */
+    int fuse;               /* fold plain cat stages into redirections of their neighbours */
+    int meter;              /* relay every pipe through a meter stage and report throughput */
+    int trace;              /* record fork, exec, pipe, dup2, wait and signal events (see trace.h) */
+    int stats;              /* time every command for the stats builtin */
+    int perf;               /* software perf counters on every stage, reported when the job is reaped */
+} shellOptions;
+
+extern shellOptions options;
+
+/* Sets the named option. Returns 0 on success, -1 for an unknown name or value */
+int setOption(const char *name, const char *value);
+
+void printOptions(void);
+
+#endif //LAB6_OPTIONS_H
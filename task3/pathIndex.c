@@ -0,0 +1,349 @@
+#define _GNU_SOURCE
+#include "pathIndex.h"
+#include "eventLoop.h"
+#include "memstat.h"
+#include <linux/limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/inotify.h>
+
+#define DENTS_BUFFER_SIZE (32 * 1024)
+#define EVENTS_BUFFER_SIZE (16 * 1024)
+
+#define WATCHED_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+#define PARENT_EVENTS (IN_CREATE | IN_MOVED_TO)
+
+/* what the getdents64 syscall fills in */
+typedef struct linuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} linuxDirent64;
+
+typedef struct pathEntry {
+    char *name;
+    uint64_t dirs;          /* bit i: directory i of PATH holds an executable of this name */
+} pathEntry;
+
+typedef struct pathDir {
+    char *path;
+    int watch;              /* inotify watch descriptor, -1 while the directory is missing */
+    int parent;             /* watch on its parent while it is missing, to see it come back. -1 when none */
+} pathDir;
+
+static pathEntry *entries = NULL;
+static size_t entry_count = 0, entry_capacity = 0;
+static pathDir dirs[PATH_INDEX_DIRS];
+static int dir_count = 0;
+static int relative_after = PATH_INDEX_DIRS;   /* dirs from this one on come after a relative entry of PATH */
+static int notify_fd = -1;
+
+/* ----- Sorted array ----- */
+/* position of name, or where it would go */
+static size_t findName(const char *name, int *found) {
+    size_t lo = 0, hi = entry_count;
+
+    *found = 0;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int order = strcmp(entries[mid].name, name);
+
+        if (order == 0) {
+            *found = 1;
+            return mid;
+        }
+        if (order < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void setDir(const char *name, int dir) {
+    int found;
+    size_t at = findName(name, &found);
+
+    if (found) {
+        entries[at].dirs |= 1ULL << dir;
+        return;
+    }
+
+    if (entry_count == entry_capacity) {
+        entry_capacity = entry_capacity ? entry_capacity * 2 : 1024;
+        entries = memRealloc(MEM_COMMANDS, entries, entry_capacity * sizeof(pathEntry));
+    }
+    memmove(entries + at + 1, entries + at, (entry_count - at) * sizeof(pathEntry));
+    entries[at].name = memStrdup(MEM_COMMANDS, name);
+    entries[at].dirs = 1ULL << dir;
+    entry_count++;
+}
+
+static void removeEntry(size_t at) {
+    memFree(entries[at].name);
+    memmove(entries + at, entries + at + 1, (entry_count - at - 1) * sizeof(pathEntry));
+    entry_count--;
+}
+
+static void clearDir(const char *name, int dir) {
+    int found;
+    size_t at = findName(name, &found);
+
+    if (found && (entries[at].dirs &= ~(1ULL << dir)) == 0)
+        removeEntry(at);
+}
+
+/* drops directory dir from every name in one pass */
+static void forgetDir(int dir) {
+    size_t i, kept = 0;
+
+    for (i = 0; i < entry_count; i++) {
+        if ((entries[i].dirs &= ~(1ULL << dir)) == 0)
+            memFree(entries[i].name);
+        else
+            entries[kept++] = entries[i];
+    }
+    entry_count = kept;
+}
+
+/* ----- Scanning ----- */
+/* regular files we may execute, symlinks followed. type is d_type, DT_UNKNOWN when the fs does not say */
+static int isExecutable(int dirfd, const char *name, unsigned char type) {
+    struct stat st;
+
+    if (type != DT_REG && (fstatat(dirfd, name, &st, 0) == -1 || !S_ISREG(st.st_mode)))
+        return 0;
+    return faccessat(dirfd, name, X_OK, 0) == 0;
+}
+
+static void scanDir(int dir) {
+    char buffer[DENTS_BUFFER_SIZE];
+    long n;
+    int fd;
+
+    if ((fd = open(dirs[dir].path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return;
+
+    while ((n = syscall(SYS_getdents64, fd, buffer, sizeof(buffer))) > 0) {
+        long offset;
+
+        for (offset = 0; offset < n; offset += ((linuxDirent64 *) (buffer + offset))->d_reclen) {
+            linuxDirent64 *d = (linuxDirent64 *) (buffer + offset);
+
+            if (d->d_type != DT_DIR && d->d_name[0] != '.' && isExecutable(fd, d->d_name, d->d_type))
+                setDir(d->d_name, dir);
+        }
+    }
+
+    close(fd);
+}
+
+/* one name of directory dir changed: it is looked at again */
+static void recheck(int dir, const char *name) {
+    int fd;
+
+    if ((fd = open(dirs[dir].path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return;
+
+    if (name[0] != '.' && isExecutable(fd, name, DT_UNKNOWN))
+        setDir(name, dir);
+    else
+        clearDir(name, dir);
+    close(fd);
+}
+
+/* ----- inotify ----- */
+/* watches and scans directory dir, or watches its parent while it is missing */
+static void watchDir(int dir) {
+    const char *path = dirs[dir].path, *slash = strrchr(path, '/');
+    char parent[PATH_MAX];
+
+    if ((dirs[dir].watch = inotify_add_watch(notify_fd, path, WATCHED_EVENTS | IN_ONLYDIR)) == -1) {
+        /* IN_MASK_ADD: the parent may be watched for its own sake, as a directory of PATH */
+        snprintf(parent, sizeof(parent), "%.*s", slash == path ? 1 : (int) (slash - path), path);
+        dirs[dir].parent = inotify_add_watch(notify_fd, parent, PARENT_EVENTS | IN_ONLYDIR | IN_MASK_ADD);
+
+        /* made in between, before the parent was watched */
+        if ((dirs[dir].watch = inotify_add_watch(notify_fd, path, WATCHED_EVENTS | IN_ONLYDIR)) == -1)
+            return;
+    }
+
+    /* the watch goes first: a change made during the scan is an event, not a miss */
+    dirs[dir].parent = -1;
+    scanDir(dir);
+}
+
+static void applyEvent(const struct inotify_event *event) {
+    int i;
+
+    /* events were lost: everything is read again */
+    if (event->mask & IN_Q_OVERFLOW) {
+        for (i = 0; i < dir_count; i++) {
+            forgetDir(i);
+            if (dirs[i].watch != -1)
+                scanDir(i);
+            else
+                watchDir(i);
+        }
+        return;
+    }
+
+    /* a directory can be in PATH under two names (/bin and /usr/bin), both get the event */
+    for (i = 0; i < dir_count; i++) {
+        if (dirs[i].watch == -1) {
+            if (dirs[i].parent == event->wd && event->len > 0 && (event->mask & PARENT_EVENTS)
+                && strcmp(strrchr(dirs[i].path, '/') + 1, event->name) == 0)
+                watchDir(i);
+            continue;
+        }
+
+        if (dirs[i].watch != event->wd)
+            continue;
+
+        if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {
+            forgetDir(i);
+            if (!(event->mask & IN_IGNORED))
+                inotify_rm_watch(notify_fd, dirs[i].watch);
+            watchDir(i);
+        } else if (event->len > 0)
+            recheck(i, event->name);
+    }
+}
+
+void pathIndexSync(void) {
+    char buffer[EVENTS_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+
+    if (notify_fd == -1)
+        return;
+
+    while ((n = read(notify_fd, buffer, sizeof(buffer))) > 0) {
+        ssize_t offset;
+
+        for (offset = 0; offset < n; offset += sizeof(struct inotify_event) + ((struct inotify_event *) (buffer + offset))->len)
+            applyEvent((struct inotify_event *) (buffer + offset));
+    }
+}
+
+static void pathEvents(int fd, uint32_t events, void *arg) {
+    pathIndexSync();
+}
+
+/* ----- Index ----- */
+int pathIndexInit(const char *path) {
+    const char *dir, *end;
+    size_t length;
+    int i;
+
+    pathIndexFree();
+
+    if (path == NULL || (notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+        return -1;
+
+    /* relative entries (and the empty one, meaning .) change with cd, execvp keeps those */
+    for (dir = path; dir != NULL && dir_count < PATH_INDEX_DIRS; dir = *end ? end + 1 : NULL) {
+        end = dir + strcspn(dir, ":");
+        if (dir[0] != '/') {
+            if (relative_after > dir_count)
+                relative_after = dir_count;
+            continue;
+        }
+
+        /* /usr/bin/ is /usr/bin, the parent of a missing directory is found from its last slash */
+        for (length = end - dir; length > 1 && dir[length - 1] == '/'; length--);
+        for (i = 0; i < dir_count && (strncmp(dirs[i].path, dir, length) != 0 || dirs[i].path[length] != 0); i++);
+        if (i < dir_count)
+            continue;
+
+        dirs[dir_count].path = memAlloc(MEM_COMMANDS, length + 1);
+        memcpy(dirs[dir_count].path, dir, length);
+        dirs[dir_count].path[length] = 0;
+        dir_count++;
+    }
+
+    for (i = 0; i < dir_count; i++)
+        watchDir(i);
+
+    if (loopAddFd(notify_fd, EPOLLIN, pathEvents, NULL) == -1) {
+        pathIndexFree();
+        return -1;
+    }
+    return 0;
+}
+
+const char *pathLookup(const char *name) {
+    int found, dir;
+    size_t at;
+
+    if (entry_count == 0)
+        return NULL;
+
+    at = findName(name, &found);
+    if (!found)
+        return NULL;
+
+    /* the lowest bit is the directory first in PATH. One after a relative entry is left to execvp, */
+    /* which looks in the relative one first */
+    dir = __builtin_ctzll(entries[at].dirs);
+    return dir < relative_after ? dirs[dir].path : NULL;
+}
+
+size_t pathRange(const char *prefix, size_t length, size_t *first) {
+    size_t lo = 0, hi = entry_count, end;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (strncmp(entries[mid].name, prefix, length) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *first = lo;
+
+    for (hi = entry_count; lo < hi;) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (strncmp(entries[mid].name, prefix, length) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    end = lo;
+
+    return end - *first;
+}
+
+const char *pathName(size_t position) {
+    return entries[position].name;
+}
+
+void pathIndexFree(void) {
+    size_t i;
+
+    for (i = 0; i < entry_count; i++)
+        memFree(entries[i].name);
+    memFree(entries);
+    entries = NULL;
+    entry_count = entry_capacity = 0;
+
+    for (i = 0; i < (size_t) dir_count; i++)
+        memFree(dirs[i].path);
+    dir_count = 0;
+    relative_after = PATH_INDEX_DIRS;
+
+    if (notify_fd != -1) {
+        loopRemoveFd(notify_fd);
+        close(notify_fd);
+        notify_fd = -1;
+    }
+}
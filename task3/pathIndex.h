@@ -0,0 +1,35 @@
+//
+// Executables of PATH: every absolute PATH directory is read once with getdents64 into a sorted array of
+// names, then kept current from inotify events on the directories. A directory that goes missing is waited
+// for in its parent and read again when it comes back. Tab completion takes prefix ranges from it and the
+// launcher execs the indexed path instead of letting execvp try each directory in turn.
+//
+
+#ifndef LAB6_PATHINDEX_H
+#define LAB6_PATHINDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PATH_INDEX_DIRS 64      /* directories past these are left to execvp */
+
+/* (Re)builds the index for the directories of path (a PATH value) and watches them from the event loop */
+/* Returns 0 on success, -1 when there is no index (lookups find nothing, execvp does the search) */
+int pathIndexInit(const char *path);
+
+/* Applies the inotify events already queued, so a job launched next sees every change made so far */
+void pathIndexSync(void);
+
+/* Directory of the first PATH entry holding the executable name, NULL when the index has none or a */
+/* relative entry (., bin, the empty one) comes before that directory: execvp has to look there first */
+const char *pathLookup(const char *name);
+
+/* Number of names starting with the length bytes of prefix, *first is the position of the first one */
+size_t pathRange(const char *prefix, size_t length, size_t *first);
+
+/* Name at a position returned by pathRange */
+const char *pathName(size_t position);
+
+void pathIndexFree(void);
+
+#endif //LAB6_PATHINDEX_H
@@ -0,0 +1,105 @@
+#define _GNU_SOURCE
+#include "perfCounters.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static const unsigned long long event_configs[PERF_EVENTS] = {
+        PERF_COUNT_SW_TASK_CLOCK,
+        PERF_COUNT_SW_CONTEXT_SWITCHES,
+        PERF_COUNT_SW_CPU_MIGRATIONS,
+        PERF_COUNT_SW_PAGE_FAULTS,
+};
+
+/* with perf_event_paranoid >= 2 only user-space counting is allowed, found on the first refusal */
+static int exclude_kernel = 0;
+
+void perfInit(perfCounters *c) {
+    int i;
+
+    for (i = 0; i < PERF_EVENTS; i++) {
+        c->fds[i] = -1;
+        c->values[i] = 0;
+    }
+    c->collected = 0;
+}
+
+static int openCounter(unsigned long long config, pid_t pid) {
+    struct perf_event_attr attr;
+    int fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.enable_on_exec = 1;
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+    attr.exclude_kernel = exclude_kernel;
+
+    fd = (int) syscall(SYS_perf_event_open, &attr, pid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+
+    if (fd == -1 && (errno == EACCES || errno == EPERM) && !exclude_kernel) {
+        exclude_kernel = 1;
+        return openCounter(config, pid);
+    }
+
+    return fd;
+}
+
+int perfAttach(perfCounters *c, pid_t pid) {
+    int i;
+
+    for (i = 0; i < PERF_EVENTS; i++) {
+        if ((c->fds[i] = openCounter(event_configs[i], pid)) == -1) {
+            int saved = errno;
+            perfClose(c);
+            errno = saved;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void perfCollect(perfCounters *c) {
+    int i;
+
+    if (c->fds[0] == -1)
+        return;
+
+    for (i = 0; i < PERF_EVENTS; i++)
+        if (read(c->fds[i], &c->values[i], sizeof(c->values[i])) != sizeof(c->values[i]))
+            c->values[i] = 0;
+
+    perfClose(c);
+    c->collected = 1;
+}
+
+void perfClose(perfCounters *c) {
+    int i;
+
+    for (i = 0; i < PERF_EVENTS; i++) {
+        if (c->fds[i] != -1)
+            close(c->fds[i]);
+        c->fds[i] = -1;
+    }
+}
+
+void perfAdd(perfCounters *into, const perfCounters *from) {
+    int i;
+
+    for (i = 0; i < PERF_EVENTS; i++)
+        into->values[i] += from->values[i];
+    into->collected |= from->collected;
+}
+
+void perfPrint(const char *label, const perfCounters *c) {
+    fprintf(stderr, "perf: %-16s %10.3f ms task-clock %8llu context-switches %6llu cpu-migrations %8llu page-faults%s\n",
+            label, c->values[PERF_TASK_CLOCK] / 1e6, c->values[PERF_CONTEXT_SWITCHES],
+            c->values[PERF_CPU_MIGRATIONS], c->values[PERF_PAGE_FAULTS], exclude_kernel ? " (user only)" : "");
+}
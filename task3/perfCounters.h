@@ -0,0 +1,44 @@
+//
+// `set perf on`: software perf counters (task-clock, context switches, cpu migrations, page faults)
+// attached by the shell to every stage between fork and exec. They follow the stage's own children
+// and need no PMU, so they work on virtual machines too.
+//
+
+#ifndef LAB6_PERFCOUNTERS_H
+#define LAB6_PERFCOUNTERS_H
+
+#include <sys/types.h>
+
+enum perfEvent {
+    PERF_TASK_CLOCK,
+    PERF_CONTEXT_SWITCHES,
+    PERF_CPU_MIGRATIONS,
+    PERF_PAGE_FAULTS,
+    PERF_EVENTS
+};
+
+typedef struct perfCounters {
+    int fds[PERF_EVENTS];                       /* -1 when not attached */
+    unsigned long long values[PERF_EVENTS];     /* task-clock in ns, the rest are counts */
+    int collected;                              /* values hold the final totals */
+} perfCounters;
+
+void perfInit(perfCounters *c);
+
+/* Attaches disabled counters to pid that start on its next exec and are inherited by its children */
+/* Must run before the child execs. Returns 0 on success, -1 when perf_event_open refused (errno is kept) */
+int perfAttach(perfCounters *c, pid_t pid);
+
+/* Reads the totals of an exited process and closes the counters */
+void perfCollect(perfCounters *c);
+
+/* Closes the counters without reading them */
+void perfClose(perfCounters *c);
+
+/* Adds the totals of from to into */
+void perfAdd(perfCounters *into, const perfCounters *from);
+
+/* Prints one line of totals to stderr */
+void perfPrint(const char *label, const perfCounters *c);
+
+#endif //LAB6_PERFCOUNTERS_H
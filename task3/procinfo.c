@@ -0,0 +1,113 @@
+#define _GNU_SOURCE
+#include "procinfo.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/resource.h>
+
+/* descriptors kept open at once; past the budget a sample opens and closes the file */
+static int cache_budget = -1;
+static int cached = 0;
+
+static long clock_ticks = 0;
+static long page_kb = 0;
+
+static long long nowNs(clockid_t clock) {
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* half of the descriptor limit, the rest stays for pipes, pidfds and redirections */
+static void initOnce(void) {
+    struct rlimit limit;
+
+    if (cache_budget != -1)
+        return;
+
+    clock_ticks = sysconf(_SC_CLK_TCK);
+    page_kb = sysconf(_SC_PAGESIZE) / 1024;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+        cache_budget = (int) (limit.rlim_cur / 2);
+    else
+        cache_budget = 512;
+}
+
+void procSamplerInit(procSampler *s) {
+    s->fd = -1;
+    s->lastTicks = 0;
+    s->lastNs = 0;
+}
+
+static ssize_t readStat(procSampler *s, pid_t pid, char *buffer, size_t size) {
+    char path[64];
+    int fd = s->fd;
+    ssize_t n;
+
+    if (fd == -1) {
+        snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+        if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+            return -1;
+    }
+
+    n = pread(fd, buffer, size - 1, 0);
+
+    if (s->fd == fd)
+        return n;
+
+    if (n > 0 && cached < cache_budget) {
+        s->fd = fd;
+        cached++;
+    } else
+        close(fd);
+
+    return n;
+}
+
+int procSample(procSampler *s, pid_t pid, procUsage *usage) {
+    char buffer[1024], *fields;
+    unsigned long long utime, stime, start, ticks;
+    long long now;
+    ssize_t n;
+
+    initOnce();
+
+    if ((n = readStat(s, pid, buffer, sizeof(buffer))) <= 0)
+        return -1;
+    buffer[n] = 0;
+
+    /* the command name may hold spaces and parentheses, the fields start after the last ')' */
+    if ((fields = strrchr(buffer, ')')) == NULL)
+        return -1;
+
+    if (sscanf(fields + 2, "%c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %*d %*d %ld %*d %llu %*u %ld",
+               &usage->state, &utime, &stime, &usage->threads, &start, &usage->rssKb) != 6)
+        return -1;
+
+    usage->rssKb *= page_kb;
+    usage->elapsed = nowNs(CLOCK_BOOTTIME) / 1e9 - (double) start / clock_ticks;
+
+    ticks = utime + stime;
+    now = nowNs(CLOCK_MONOTONIC);
+
+    if (s->lastNs != 0 && now > s->lastNs)
+        usage->cpuPercent = 100.0 * (ticks - s->lastTicks) / clock_ticks / ((now - s->lastNs) / 1e9);
+    else
+        usage->cpuPercent = usage->elapsed > 0 ? 100.0 * ticks / clock_ticks / usage->elapsed : 0;
+
+    s->lastTicks = ticks;
+    s->lastNs = now;
+    return 0;
+}
+
+void procSamplerClose(procSampler *s) {
+    if (s->fd != -1) {
+        close(s->fd);
+        cached--;
+        s->fd = -1;
+    }
+}
@@ -0,0 +1,33 @@
+//
+// Live usage of tracked processes for showprocs, sampled from /proc/<pid>/stat through a descriptor
+// kept open per process, so a refresh costs one pread per process.
+//
+
+#ifndef LAB6_PROCINFO_H
+#define LAB6_PROCINFO_H
+
+#include <sys/types.h>
+
+typedef struct procSampler {
+    int fd;                         /* cached /proc/<pid>/stat, -1 until the first sample */
+    unsigned long long lastTicks;   /* utime + stime at the previous sample */
+    long long lastNs;               /* CLOCK_MONOTONIC of the previous sample, 0 before the first */
+} procSampler;
+
+typedef struct procUsage {
+    char state;                     /* R, S, D, T, Z... as the kernel reports it */
+    double cpuPercent;              /* since the previous sample, over the whole life for the first */
+    long rssKb;
+    long threads;
+    double elapsed;                 /* seconds since the process started */
+} procUsage;
+
+void procSamplerInit(procSampler *s);
+
+/* Samples pid. Returns 0 on success, -1 when the process is gone or /proc can't be read */
+int procSample(procSampler *s, pid_t pid, procUsage *usage);
+
+/* Closes the cached descriptor */
+void procSamplerClose(procSampler *s);
+
+#endif //LAB6_PROCINFO_H
@@ -0,0 +1,220 @@
+#define _GNU_SOURCE
+#include "resourceLimits.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#define UNIT_SIZE 0
+#define UNIT_SECONDS 1
+#define UNIT_COUNT 2
+
+static const struct {
+    const char *key;
+    int resource;
+    int unit;
+} limit_keys[] = {
+        {"mem",    RLIMIT_AS,     UNIT_SIZE},
+        {"cpu",    RLIMIT_CPU,    UNIT_SECONDS},
+        {"nofile", RLIMIT_NOFILE, UNIT_COUNT},
+        {"fsize",  RLIMIT_FSIZE,  UNIT_SIZE},
+        {"nproc",  RLIMIT_NPROC,  UNIT_COUNT},
+        {"stack",  RLIMIT_STACK,  UNIT_SIZE},
+        {"core",   RLIMIT_CORE,   UNIT_SIZE},
+};
+
+#define LIMIT_KEYS ((int) (sizeof(limit_keys) / sizeof(limit_keys[0])))
+
+/* 2G, 512M, 30s, 5m, 1h, 4096, unlimited */
+static int parseValue(const char *str, int unit, rlim_t *value) {
+    char *end;
+    unsigned long long number;
+    unsigned long long scale = 1;
+
+    if (strcmp(str, "unlimited") == 0) {
+        *value = RLIM_INFINITY;
+        return 0;
+    }
+
+    number = strtoull(str, &end, 10);
+    if (end == str)
+        return -1;
+
+    if (*end != 0) {
+        if (end[1] != 0)
+            return -1;
+
+        if (unit == UNIT_SIZE) {
+            switch (*end) {
+                case 'k': case 'K': scale = 1ULL << 10; break;
+                case 'm': case 'M': scale = 1ULL << 20; break;
+                case 'g': case 'G': scale = 1ULL << 30; break;
+                case 't': case 'T': scale = 1ULL << 40; break;
+                default: return -1;
+            }
+        } else if (unit == UNIT_SECONDS) {
+            switch (*end) {
+                case 's': scale = 1; break;
+                case 'm': scale = 60; break;
+                case 'h': scale = 3600; break;
+                default: return -1;
+            }
+        } else
+            return -1;
+    }
+
+    *value = (rlim_t) (number * scale);
+    return 0;
+}
+
+static void formatValue(const resourceLimit *limit, char *buf, int size) {
+    int i;
+
+    for (i = 0; i < LIMIT_KEYS && limit_keys[i].resource != limit->resource; i++);
+
+    if (limit->value == RLIM_INFINITY)
+        snprintf(buf, size, "unlimited");
+    else if (i < LIMIT_KEYS && limit_keys[i].unit == UNIT_SECONDS)
+        snprintf(buf, size, "%llus", (unsigned long long) limit->value);
+    else if (i < LIMIT_KEYS && limit_keys[i].unit == UNIT_SIZE && limit->value >= (1 << 20))
+        snprintf(buf, size, "%lluM", (unsigned long long) limit->value >> 20);
+    else
+        snprintf(buf, size, "%llu", (unsigned long long) limit->value);
+}
+
+static const resourceLimit *findLimit(const limitSet *limits, int resource) {
+    int i;
+
+    for (i = 0; i < limits->count; i++)
+        if (limits->limits[i].resource == resource)
+            return &limits->limits[i];
+
+    return NULL;
+}
+
+int parseLimitPrefix(cmdLine *command, limitSet *limits) {
+    int arg = 1;
+
+    limits->count = 0;
+
+    if (command->argCount == 0 || strcmp(command->arguments[0], "limit") != 0)
+        return 0;
+
+    for (; arg < command->argCount; arg++) {
+        char *setting = command->arguments[arg];
+        char *equals = strchr(setting, '=');
+        int i;
+
+        if (strcmp(setting, "--") == 0) {
+            arg++;
+            break;
+        }
+
+        if (equals == NULL)     /* the command itself, `--` is optional */
+            break;
+
+        *equals = 0;
+        for (i = 0; i < LIMIT_KEYS && strcmp(limit_keys[i].key, setting) != 0; i++);
+        *equals = '=';
+
+        /* a key given twice is a mistake, not an override */
+        if (i == LIMIT_KEYS || findLimit(limits, limit_keys[i].resource) != NULL || limits->count == MAX_LIMITS) {
+            fprintf(stderr, "limit: unknown or repeated setting %s\n", setting);
+            return -1;
+        }
+
+        resourceLimit *limit = &limits->limits[limits->count];
+        limit->key = limit_keys[i].key;
+        limit->resource = limit_keys[i].resource;
+
+        if (parseValue(equals + 1, limit_keys[i].unit, &limit->value) == -1) {
+            fprintf(stderr, "limit: bad value in %s\n", setting);
+            return -1;
+        }
+        limits->count++;
+    }
+
+    if (arg >= command->argCount) {
+        fprintf(stderr, "usage: limit key=value... -- command\n");
+        return -1;
+    }
+
+    removeCmdArgs(command, 0, arg);
+    return 1;
+}
+
+void applyLimits(const limitSet *limits) {
+    int i;
+
+    for (i = 0; i < limits->count; i++) {
+        const resourceLimit *limit = &limits->limits[i];
+        struct rlimit current, wanted;
+
+        if (getrlimit(limit->resource, &current) == -1) {
+            perror("getrlimit failed");
+            _exit(126);
+        }
+
+        wanted.rlim_cur = limit->value;
+        wanted.rlim_max = limit->value;
+
+        /* leave one second between SIGXCPU and the kernel's SIGKILL so the breach is recognisable */
+        if (limit->resource == RLIMIT_CPU && limit->value != RLIM_INFINITY)
+            wanted.rlim_max = limit->value + 1;
+
+        if (current.rlim_max != RLIM_INFINITY && (wanted.rlim_max == RLIM_INFINITY || wanted.rlim_max > current.rlim_max))
+            wanted.rlim_max = current.rlim_max;
+
+        if (setrlimit(limit->resource, &wanted) == -1) {
+            fprintf(stderr, "limit: can't set %s: ", limit->key);
+            perror("setrlimit failed");
+            _exit(126);
+        }
+    }
+}
+
+int describeLimitBreach(const limitSet *limits, int waitStatus, const struct rusage *usage,
+                        char *reason, int size) {
+    const resourceLimit *limit;
+    char value[32];
+    int sig;
+
+    if (limits == NULL || !WIFSIGNALED(waitStatus))
+        return 0;
+
+    sig = WTERMSIG(waitStatus);
+
+    if ((limit = findLimit(limits, RLIMIT_CPU)) != NULL &&
+        (sig == SIGXCPU || (sig == SIGKILL && usage->ru_utime.tv_sec + usage->ru_stime.tv_sec >= (long) limit->value))) {
+        formatValue(limit, value, sizeof(value));
+        long cpu_ms = (usage->ru_utime.tv_sec + usage->ru_stime.tv_sec) * 1000L +
+                      (usage->ru_utime.tv_usec + usage->ru_stime.tv_usec) / 1000L;
+        snprintf(reason, size, "cpu limit %s exceeded (SIG%s after %ld.%03lds)", value, sigabbrev_np(sig),
+                 cpu_ms / 1000, cpu_ms % 1000);
+        return 1;
+    }
+
+    if ((limit = findLimit(limits, RLIMIT_FSIZE)) != NULL && sig == SIGXFSZ) {
+        formatValue(limit, value, sizeof(value));
+        snprintf(reason, size, "fsize limit %s exceeded (SIGXFSZ)", value);
+        return 1;
+    }
+
+    /* a failed allocation under RLIMIT_AS usually ends in an abort or a crash on the NULL result */
+    if ((limit = findLimit(limits, RLIMIT_AS)) != NULL && (sig == SIGSEGV || sig == SIGABRT || sig == SIGBUS)) {
+        formatValue(limit, value, sizeof(value));
+        snprintf(reason, size, "probably hit mem limit %s (SIG%s, peak rss %ldM)", value, sigabbrev_np(sig),
+                 usage->ru_maxrss >> 10);
+        return 1;
+    }
+
+    if ((limit = findLimit(limits, RLIMIT_STACK)) != NULL && sig == SIGSEGV) {
+        formatValue(limit, value, sizeof(value));
+        snprintf(reason, size, "probably hit stack limit %s (SIGSEGV)", value);
+        return 1;
+    }
+
+    return 0;
+}
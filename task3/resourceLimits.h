@@ -0,0 +1,36 @@
+//
+// The limit prefix: `limit mem=2G cpu=30s nofile=4096 -- cmd | cmd2` caps every stage of the job.
+//
+
+#ifndef LAB6_RESOURCELIMITS_H
+#define LAB6_RESOURCELIMITS_H
+
+#include "LineParser.h"
+#include <sys/resource.h>
+
+#define MAX_LIMITS 8
+
+typedef struct resourceLimit {
+    const char *key;        /* name used in the prefix (mem, cpu, ...) */
+    int resource;           /* RLIMIT_* */
+    rlim_t value;
+} resourceLimit;
+
+typedef struct limitSet {
+    int count;
+    resourceLimit limits[MAX_LIMITS];
+} limitSet;
+
+/* Strips a leading `limit key=value... [--]` from the arguments of command into limits */
+/* Returns 1 when a prefix was consumed, 0 when there is none, -1 on a malformed prefix (already reported) */
+int parseLimitPrefix(cmdLine *command, limitSet *limits);
+
+/* Applies the limits in a forked child before exec. Exits the child when one can't be set */
+void applyLimits(const limitSet *limits);
+
+/* Explains why a stage that ended with waitStatus after using usage most likely hit one of the limits */
+/* Returns 1 and fills reason when a breach is recognised, 0 otherwise */
+int describeLimitBreach(const limitSet *limits, int waitStatus, const struct rusage *usage,
+                        char *reason, int size);
+
+#endif //LAB6_RESOURCELIMITS_H
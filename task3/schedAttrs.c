@@ -0,0 +1,163 @@
+#define _GNU_SOURCE
+#include "schedAttrs.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+
+int parseCpuList(const char *list, cpu_set_t *cpus) {
+    const char *s = list;
+
+    CPU_ZERO(cpus);
+
+    while (*s) {
+        char *end;
+        long low = strtol(s, &end, 10), high;
+
+        if (end == s || low < 0)
+            return -1;
+
+        high = low;
+        if (*end == '-') {
+            s = end + 1;
+            high = strtol(s, &end, 10);
+            if (end == s || high < low)
+                return -1;
+        }
+
+        if (high >= CPU_SETSIZE)
+            return -1;
+
+        for (; low <= high; low++)
+            CPU_SET(low, cpus);
+
+        if (*end == ',')
+            end++;
+        else if (*end != 0)
+            return -1;
+        s = end;
+    }
+
+    return CPU_COUNT(cpus) > 0 ? 0 : -1;
+}
+
+/* rt:0-7, be:0-7 or idle */
+static int parseIoprio(const char *str, int *ioprio) {
+    int class, level = 4;
+    const char *colon = strchr(str, ':');
+    size_t len = colon ? (size_t) (colon - str) : strlen(str);
+
+    if (len == 2 && strncmp(str, "rt", 2) == 0)
+        class = IOPRIO_CLASS_RT;
+    else if (len == 2 && strncmp(str, "be", 2) == 0)
+        class = IOPRIO_CLASS_BE;
+    else if (len == 4 && strncmp(str, "idle", 4) == 0)
+        class = IOPRIO_CLASS_IDLE;
+    else
+        return -1;
+
+    if (colon != NULL) {
+        char *end;
+        level = (int) strtol(colon + 1, &end, 10);
+        if (end == colon + 1 || *end != 0 || level < 0 || level > 7)
+            return -1;
+    }
+
+    if (class == IOPRIO_CLASS_IDLE)
+        level = 0;
+
+    *ioprio = class << IOPRIO_CLASS_SHIFT | level;
+    return 0;
+}
+
+int parseSchedPrefix(cmdLine *command, schedAttrs *attrs, int *jobWide) {
+    int arg = 1;
+
+    memset(attrs, 0, sizeof(schedAttrs));
+    *jobWide = 0;
+
+    if (command->argCount == 0 || strcmp(command->arguments[0], "sched") != 0)
+        return 0;
+
+    for (; arg < command->argCount; arg++) {
+        char *setting = command->arguments[arg];
+        char *value = strchr(setting, '=');
+        char *end;
+        int ok = 0;
+
+        if (strcmp(setting, "--") == 0) {
+            arg++;
+            break;
+        }
+
+        if (strcmp(setting, "-j") == 0) {
+            *jobWide = 1;
+            continue;
+        }
+
+        if (value == NULL)      /* the command itself, `--` is optional */
+            break;
+        value++;
+
+        if (strncmp(setting, "cpus=", 5) == 0)
+            ok = (attrs->hasCpus = parseCpuList(value, &attrs->cpus) == 0);
+
+        else if (strncmp(setting, "nice=", 5) == 0) {
+            attrs->nice = (int) strtol(value, &end, 10);
+            ok = attrs->hasNice = end != value && *end == 0 && attrs->nice >= -20 && attrs->nice <= 19;
+        }
+
+        else if (strncmp(setting, "io=", 3) == 0)
+            ok = (attrs->hasIoprio = parseIoprio(value, &attrs->ioprio) == 0);
+
+        if (!ok) {
+            fprintf(stderr, "sched: bad setting %s (cpus=LIST nice=-20..19 io=rt:N|be:N|idle)\n", setting);
+            return -1;
+        }
+    }
+
+    if (arg >= command->argCount) {
+        fprintf(stderr, "usage: sched [-j] key=value... -- command\n");
+        return -1;
+    }
+
+    removeCmdArgs(command, 0, arg);
+    return 1;
+}
+
+void mergeSchedAttrs(schedAttrs *stage, const schedAttrs *job) {
+    if (!stage->hasCpus && job->hasCpus) {
+        stage->hasCpus = 1;
+        stage->cpus = job->cpus;
+    }
+    if (!stage->hasNice && job->hasNice) {
+        stage->hasNice = 1;
+        stage->nice = job->nice;
+    }
+    if (!stage->hasIoprio && job->hasIoprio) {
+        stage->hasIoprio = 1;
+        stage->ioprio = job->ioprio;
+    }
+}
+
+void applySchedAttrs(const schedAttrs *attrs) {
+    if (attrs->hasCpus && sched_setaffinity(0, sizeof(cpu_set_t), &attrs->cpus) == -1) {
+        perror("sched: sched_setaffinity failed");
+        _exit(126);
+    }
+
+    if (attrs->hasNice && setpriority(PRIO_PROCESS, 0, attrs->nice) == -1) {
+        perror("sched: setpriority failed");
+        _exit(126);
+    }
+
+    if (attrs->hasIoprio && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, attrs->ioprio) == -1) {
+        perror("sched: ioprio_set failed");
+        _exit(126);
+    }
+}
@@ -0,0 +1,38 @@
+//
+// The sched prefix: `sched cpus=0-3 nice=10 io=be:4 -- cmd` places a stage, `sched -j ...` the whole job.
+//
+
+#ifndef LAB6_SCHEDATTRS_H
+#define LAB6_SCHEDATTRS_H
+
+#include "LineParser.h"
+#include <sched.h>
+
+#define IOPRIO_CLASS_RT 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+
+typedef struct schedAttrs {
+    int hasCpus;
+    cpu_set_t cpus;
+    int hasNice;
+    int nice;
+    int hasIoprio;
+    int ioprio;             /* class << 13 | level, as ioprio_set takes it */
+} schedAttrs;
+
+/* Strips a leading `sched [-j] key=value... [--]` from the arguments of command into attrs */
+/* jobWide is set when -j was given */
+/* Returns 1 when a prefix was consumed, 0 when there is none, -1 on a malformed prefix (already reported) */
+int parseSchedPrefix(cmdLine *command, schedAttrs *attrs, int *jobWide);
+
+/* Fills the settings stage doesn't have from job */
+void mergeSchedAttrs(schedAttrs *stage, const schedAttrs *job);
+
+/* Parses a cpu list such as 0-3,8,10-11. Returns 0 on success, -1 on failure */
+int parseCpuList(const char *list, cpu_set_t *cpus);
+
+/* Applies the settings in a forked child before exec. Exits the child when one can't be set */
+void applySchedAttrs(const schedAttrs *attrs);
+
+#endif //LAB6_SCHEDATTRS_H
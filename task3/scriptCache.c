@@ -0,0 +1,300 @@
+#define _GNU_SOURCE
+#include "scriptCache.h"
+#include "memstat.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#define FNV_OFFSET 14695981039346656037ULL
+
+static uint64_t fnv(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = data;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    return hash;
+}
+
+/* FNV-1a: the key only has to tell script versions apart, the file still checks hash and size */
+uint64_t cacheHash(const char *data, size_t size) {
+    return fnv(FNV_OFFSET, data, size);
+}
+
+int cachePath(uint64_t hash, char *path, size_t size) {
+    const char *base = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+    char dir[4096];
+
+    if (base != NULL && *base)
+        snprintf(dir, sizeof(dir), "%s/myshell3", base);
+    else if (home != NULL && *home) {
+        snprintf(dir, sizeof(dir), "%s/.cache", home);
+        mkdir(dir, 0700);
+        snprintf(dir, sizeof(dir), "%s/.cache/myshell3", home);
+    } else
+        return -1;
+
+    if (mkdir(dir, 0700) == -1 && errno != EEXIST)
+        return -1;
+
+    snprintf(path, size, "%s/%016llx", dir, (unsigned long long) hash);
+    return 0;
+}
+
+/* ----- Writing ----- */
+static void *grow(void *array, size_t *capacity, size_t needed, size_t element) {
+    if (needed <= *capacity)
+        return array;
+
+    *capacity = needed > *capacity * 2 ? needed : *capacity * 2;
+    return memRealloc(MEM_LINES, array, *capacity * element);
+}
+
+void cacheWriterInit(cacheWriter *w) {
+    memset(w, 0, sizeof(*w));
+}
+
+static uint32_t addString(cacheWriter *w, const char *str) {
+    size_t length, offset = w->stringsSize;
+
+    if (str == NULL)
+        return CACHE_NONE;
+
+    length = strlen(str) + 1;
+    w->strings = grow(w->strings, &w->stringsCapacity, w->stringsSize + length, 1);
+    memcpy(w->strings + offset, str, length);
+    w->stringsSize += length;
+    return (uint32_t) offset;
+}
+
+static cacheLine *addLine(cacheWriter *w) {
+    w->lines = grow(w->lines, &w->lineCapacity, w->lineCount + 1, sizeof(cacheLine));
+    return &w->lines[w->lineCount++];
+}
+
+void cacheAddCommand(cacheWriter *w, const cmdLine *command) {
+    cacheLine *line = addLine(w);
+    int i;
+
+    line->firstStage = (uint32_t) w->stageCount;
+    line->stageCount = 0;
+    line->raw = CACHE_NONE;
+
+    for (; command != NULL; command = command->next) {
+        cacheStage *stage;
+
+        w->stages = grow(w->stages, &w->stageCapacity, w->stageCount + 1, sizeof(cacheStage));
+        stage = &w->stages[w->stageCount++];
+        line->stageCount++;
+
+        stage->argCount = command->argCount;
+        stage->firstArg = (uint32_t) w->argCount;
+        stage->inputRedirect = addString(w, command->inputRedirect);
+        stage->outputRedirect = addString(w, command->outputRedirect);
+        stage->hereDocument = addString(w, command->hereDocument);
+        stage->hereDelimiter = addString(w, command->hereDelimiter);
+        stage->blocking = command->blocking;
+        stage->connector = command->connector;
+
+        w->args = grow(w->args, &w->argCapacity, w->argCount + command->argCount, sizeof(uint32_t));
+        for (i = 0; i < command->argCount; i++)
+            w->args[w->argCount++] = addString(w, command->arguments[i]);
+    }
+}
+
+void cacheAddRaw(cacheWriter *w, const char *raw) {
+    cacheLine *line = addLine(w);
+
+    line->firstStage = (uint32_t) w->stageCount;
+    line->stageCount = 0;
+    line->raw = addString(w, raw);
+}
+
+int cacheWriterSave(cacheWriter *w, const char *path, uint64_t hash, uint64_t scriptSize) {
+    char temporary[4200];
+    cacheHeader header;
+    FILE *out;
+    int ok;
+
+    /* offsets are 32 bits */
+    if (w->stringsSize >= CACHE_NONE || w->argCount >= CACHE_NONE || w->stageCount >= CACHE_NONE)
+        return -1;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.scriptHash = hash;
+    header.scriptSize = scriptSize;
+    header.lineCount = (uint32_t) w->lineCount;
+    header.stageCount = (uint32_t) w->stageCount;
+    header.argCount = (uint32_t) w->argCount;
+    header.stringsSize = (uint32_t) w->stringsSize;
+    header.bodyHash = fnv(FNV_OFFSET, w->lines, w->lineCount * sizeof(cacheLine));
+    header.bodyHash = fnv(header.bodyHash, w->stages, w->stageCount * sizeof(cacheStage));
+    header.bodyHash = fnv(header.bodyHash, w->args, w->argCount * sizeof(uint32_t));
+    header.bodyHash = fnv(header.bodyHash, w->strings, w->stringsSize);
+
+    snprintf(temporary, sizeof(temporary), "%s.%d", path, getpid());
+    if ((out = fopen(temporary, "we")) == NULL)
+        return -1;
+
+    ok = fwrite(&header, sizeof(header), 1, out) == 1
+         && fwrite(w->lines, sizeof(cacheLine), w->lineCount, out) == w->lineCount
+         && fwrite(w->stages, sizeof(cacheStage), w->stageCount, out) == w->stageCount
+         && fwrite(w->args, sizeof(uint32_t), w->argCount, out) == w->argCount
+         && fwrite(w->strings, 1, w->stringsSize, out) == w->stringsSize;
+
+    if (fclose(out) != 0 || !ok || rename(temporary, path) == -1) {
+        unlink(temporary);
+        return -1;
+    }
+    return 0;
+}
+
+void cacheWriterFree(cacheWriter *w) {
+    memFree(w->lines);
+    memFree(w->stages);
+    memFree(w->args);
+    memFree(w->strings);
+    cacheWriterInit(w);
+}
+
+/* ----- Reading ----- */
+static int validString(const scriptCache *c, uint32_t offset, int optional) {
+    return (optional && offset == CACHE_NONE) || offset < c->header->stringsSize;
+}
+
+/* every offset is checked once here, cacheNext trusts them */
+static int validate(const scriptCache *c) {
+    const cacheHeader *h = c->header;
+    uint32_t i, j;
+
+    if (h->stringsSize > 0 && c->strings[h->stringsSize - 1] != 0)
+        return -1;
+
+    for (i = 0; i < h->lineCount; i++) {
+        const cacheLine *line = &c->lines[i];
+
+        if (line->stageCount == 0 ? !validString(c, line->raw, 0)
+                                  : line->firstStage + (uint64_t) line->stageCount > h->stageCount)
+            return -1;
+    }
+
+    for (i = 0; i < h->stageCount; i++) {
+        const cacheStage *stage = &c->stages[i];
+
+        if (stage->connector > LIST_OR || stage->firstArg + (uint64_t) stage->argCount > h->argCount
+            || !validString(c, stage->inputRedirect, 1) || !validString(c, stage->outputRedirect, 1)
+            || !validString(c, stage->hereDocument, 1) || !validString(c, stage->hereDelimiter, 1))
+            return -1;
+
+        for (j = 0; j < stage->argCount; j++)
+            if (!validString(c, c->args[stage->firstArg + j], 0))
+                return -1;
+    }
+
+    return 0;
+}
+
+int cacheOpen(scriptCache *c, const char *path, uint64_t hash, uint64_t scriptSize) {
+    struct stat st;
+    uint64_t expected;
+    int fd;
+
+    memset(c, 0, sizeof(*c));
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1)
+        return -1;
+
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(cacheHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    /* private and writable: the shell may rewrite an argument in place, the file never changes */
+    c->size = st.st_size;
+    c->base = mmap(NULL, c->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (c->base == MAP_FAILED)
+        return -1;
+
+    c->header = (const cacheHeader *) c->base;
+    expected = sizeof(cacheHeader) + (uint64_t) c->header->lineCount * sizeof(cacheLine)
+               + (uint64_t) c->header->stageCount * sizeof(cacheStage)
+               + (uint64_t) c->header->argCount * sizeof(uint32_t) + c->header->stringsSize;
+
+    if (memcmp(c->header->magic, CACHE_MAGIC, sizeof(c->header->magic)) != 0 || c->header->scriptHash != hash
+        || c->header->scriptSize != scriptSize || expected != c->size
+        || fnv(FNV_OFFSET, c->header + 1, c->size - sizeof(cacheHeader)) != c->header->bodyHash) {
+        munmap(c->base, c->size);
+        return -1;
+    }
+
+    c->lines = (const cacheLine *) (c->header + 1);
+    c->stages = (const cacheStage *) (c->lines + c->header->lineCount);
+    c->args = (const uint32_t *) (c->stages + c->header->stageCount);
+    c->strings = (char *) (c->args + c->header->argCount);
+
+    if (validate(c) == -1) {
+        munmap(c->base, c->size);
+        return -1;
+    }
+
+    return 0;
+}
+
+static char *stringAt(scriptCache *c, uint32_t offset) {
+    return offset == CACHE_NONE ? NULL : c->strings + offset;
+}
+
+/* one allocation per stage, the strings stay in the mapping for the life of the shell */
+int cacheNext(scriptCache *c, scriptLine *line) {
+    const cacheLine *entry;
+    cmdLine **tail = &line->command;
+    uint32_t i, j;
+    int idx = 0;
+
+    if (c->header == NULL || c->next == c->header->lineCount)
+        return -1;
+
+    entry = &c->lines[c->next++];
+    line->command = NULL;
+    line->raw = NULL;
+    line->rawMapped = 0;
+
+    if (entry->stageCount == 0) {
+        line->raw = stringAt(c, entry->raw);
+        line->rawMapped = 1;
+        return 1;
+    }
+
+    for (i = 0; i < entry->stageCount; i++) {
+        const cacheStage *stage = &c->stages[entry->firstStage + i];
+        cmdLine *command = memCalloc(MEM_PARSER, 1, sizeof(cmdLine));
+
+        command->arguments = memCalloc(MEM_PARSER, stage->argCount + 1, sizeof(char *));
+        for (j = 0; j < stage->argCount; j++)
+            ((char **) command->arguments)[j] = stringAt(c, c->args[stage->firstArg + j]);
+        command->argCount = (int) stage->argCount;
+        command->inputRedirect = stringAt(c, stage->inputRedirect);
+        command->outputRedirect = stringAt(c, stage->outputRedirect);
+        command->hereDocument = stringAt(c, stage->hereDocument);
+        command->hereDelimiter = stringAt(c, stage->hereDelimiter);
+        command->blocking = (char) stage->blocking;
+        command->sharedBase = c->strings;
+        command->sharedSize = c->header->stringsSize;
+        command->connector = (char) stage->connector;
+        command->idx = idx++;
+        if (command->connector != LIST_PIPE)
+            idx = 0;
+
+        *tail = command;
+        tail = &command->next;
+    }
+
+    return 1;
+}
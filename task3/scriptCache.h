@@ -0,0 +1,95 @@
+//
+// Precompiled scripts: the parsed lines of a script are written to a binary file named after the hash of
+// its content. A later run of the same script maps that file and rebuilds each cmdLine chain with its
+// strings pointing into the mapping, so nothing is parsed and no argument is allocated.
+//
+// File layout (native byte order, offsets from the start of the file):
+//   cacheHeader | cacheLine[lineCount] | cacheStage[stageCount] | uint32 args[argCount] | strings
+// String references are offsets into the strings blob, CACHE_NONE for NULL.
+//
+
+#ifndef LAB6_SCRIPTCACHE_H
+#define LAB6_SCRIPTCACHE_H
+
+#include "scriptReader.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#define CACHE_MAGIC "myshc\0\0\2"      /* the last byte is the format version */
+#define CACHE_NONE UINT32_MAX
+
+typedef struct cacheHeader {
+    char magic[8];
+    uint64_t scriptHash;
+    uint64_t scriptSize;
+    uint64_t bodyHash;          /* cacheHash of everything after the header, catches a damaged file */
+    uint32_t lineCount;
+    uint32_t stageCount;
+    uint32_t argCount;
+    uint32_t stringsSize;
+} cacheHeader;
+
+typedef struct cacheLine {
+    uint32_t firstStage;
+    uint32_t stageCount;        /* 0 for a raw line */
+    uint32_t raw;               /* text of a raw line, CACHE_NONE for a parsed one */
+} cacheLine;
+
+typedef struct cacheStage {
+    uint32_t argCount;
+    uint32_t firstArg;
+    uint32_t inputRedirect;
+    uint32_t outputRedirect;
+    uint32_t hereDocument;
+    uint32_t hereDelimiter;
+    uint32_t blocking;
+    uint32_t connector;         /* LIST_* joining the stage to the next one of its line */
+} cacheStage;
+
+/* Collects the lines of a script while it is read */
+typedef struct cacheWriter {
+    cacheLine *lines;
+    cacheStage *stages;
+    uint32_t *args;
+    char *strings;
+    size_t lineCount, lineCapacity;
+    size_t stageCount, stageCapacity;
+    size_t argCount, argCapacity;
+    size_t stringsSize, stringsCapacity;
+} cacheWriter;
+
+/* A mapped cache being run */
+typedef struct scriptCache {
+    char *base;
+    size_t size;
+    const cacheHeader *header;
+    const cacheLine *lines;
+    const cacheStage *stages;
+    const uint32_t *args;
+    char *strings;
+    uint32_t next;              /* next line to hand out */
+} scriptCache;
+
+uint64_t cacheHash(const char *data, size_t size);
+
+/* Writes the cache file path for a script hash into path, creating its directory */
+/* ($XDG_CACHE_HOME or ~/.cache)/myshell3/<hash>. Returns 0 on success, -1 when there is no usable directory */
+int cachePath(uint64_t hash, char *path, size_t size);
+
+void cacheWriterInit(cacheWriter *w);
+void cacheAddCommand(cacheWriter *w, const cmdLine *command);
+void cacheAddRaw(cacheWriter *w, const char *raw);
+
+/* Writes the collected lines to path through a temporary file and a rename. Returns 0 on success, -1 on failure */
+int cacheWriterSave(cacheWriter *w, const char *path, uint64_t hash, uint64_t scriptSize);
+
+void cacheWriterFree(cacheWriter *w);
+
+/* Maps path and checks it belongs to the script with this hash and size and is well formed */
+/* Returns 0 on success, -1 when there is no usable cache */
+int cacheOpen(scriptCache *c, const char *path, uint64_t hash, uint64_t scriptSize);
+
+/* Rebuilds the next line. Returns 1 when *line was filled, -1 after the last line */
+int cacheNext(scriptCache *c, scriptLine *line);
+
+#endif //LAB6_SCRIPTCACHE_H
@@ -0,0 +1,282 @@
+#define _GNU_SOURCE
+#include "scriptReader.h"
+#include "scriptCache.h"
+#include "expand.h"
+#include "memstat.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+/* the ring, its state and the eventfd change only under queue_lock */
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_not_full = PTHREAD_COND_INITIALIZER;
+static scriptLine queue[SCRIPT_QUEUE_SIZE];
+static int queue_head = 0, queue_count = 0;
+static int script_done = 0;
+static int script_closing = 0;     /* the shell is leaving, the reader stops without a cache */
+static int ready_fd = -1;
+
+/* reader thread only */
+static FILE *script = NULL;
+static char *text = NULL;
+static size_t text_size = 0;
+static cacheWriter writer;
+
+static pthread_t reader;
+static int reader_started = 0;
+
+/* the script mapped for hashing and reading, and its precompiled form when one matched */
+static char *script_data = NULL;
+static size_t script_size = 0;
+static uint64_t script_hash = 0;
+static char cache_path[4096] = "";
+static scriptCache cache;
+static int from_cache = 0;
+
+static void wakeShell(void) {
+    uint64_t one = 1;
+    write(ready_fd, &one, sizeof(one));
+}
+
+/* Returns 0 once the shell is closing the script, the line is not queued then */
+static int push(const scriptLine *line) {
+    int queued = 0;
+
+    pthread_mutex_lock(&queue_lock);
+    while (queue_count == SCRIPT_QUEUE_SIZE && !script_closing)
+        pthread_cond_wait(&queue_not_full, &queue_lock);
+
+    if (!script_closing) {
+        queue[(queue_head + queue_count) % SCRIPT_QUEUE_SIZE] = *line;
+        queue_count++;
+        queued = 1;
+        wakeShell();
+    }
+    pthread_mutex_unlock(&queue_lock);
+
+    return queued;
+}
+
+int scriptNext(scriptLine *line) {
+    uint64_t ignored;
+    int result = 1;
+
+    /* a cached script is all there from the start, the fd stays readable */
+    if (from_cache)
+        return cacheNext(&cache, line);
+
+    pthread_mutex_lock(&queue_lock);
+
+    if (queue_count == 0) {
+        /* drained: the next push makes the fd readable again */
+        read(ready_fd, &ignored, sizeof(ignored));
+        result = script_done ? -1 : 0;
+        if (script_done)
+            wakeShell();
+    } else {
+        *line = queue[queue_head];
+        queue_head = (queue_head + 1) % SCRIPT_QUEUE_SIZE;
+        queue_count--;
+        pthread_cond_signal(&queue_not_full);
+    }
+
+    pthread_mutex_unlock(&queue_lock);
+    return result;
+}
+
+static void append(char **block, size_t *length, const char *str, size_t len) {
+    *block = memRealloc(MEM_PARSER, *block, *length + len + 1);
+    memcpy(*block + *length, str, len);
+    *length += len;
+    (*block)[*length] = 0;
+}
+
+/* Reads the body of a << here-document up to its delimiter line into *block */
+/* The delimiter line is appended too when keepDelimiter is set. Returns 0 when the script ended first */
+static int readBody(const char *delimiter, char **block, size_t *length, int keepDelimiter) {
+    ssize_t n;
+
+    while ((n = getline(&text, &text_size, script)) > 0) {
+        size_t content = text[n - 1] == '\n' ? (size_t) n - 1 : (size_t) n;
+
+        if (content == strlen(delimiter) && strncmp(text, delimiter, content) == 0) {
+            if (keepDelimiter)
+                append(block, length, text, n);
+            return 1;
+        }
+        append(block, length, text, n);
+    }
+
+    return 0;
+}
+
+static cmdLine *nextHereStage(cmdLine *stage) {
+    while (stage != NULL && (stage->hereDelimiter == NULL || stage->hereDocument != NULL))
+        stage = stage->next;
+    return stage;
+}
+
+/* a parsed line gets its here-documents attached like the shell's collectHereDocument does */
+static void attachBodies(cmdLine *command) {
+    cmdLine *stage;
+
+    for (stage = nextHereStage(command); stage != NULL; stage = nextHereStage(stage->next)) {
+        char *body = NULL;
+        size_t length = 0;
+
+        append(&body, &length, "", 0);
+        if (!readBody(stage->hereDelimiter, &body, &length, 0))
+            fprintf(stderr, "here-document delimited by end-of-file (wanted `%s')\n", stage->hereDelimiter);
+        setHereDocument(stage, body);
+    }
+}
+
+/* a raw line carries the lines of its here-documents along, the shell collects them itself */
+static char *rawBlock(parserContext *ctx, const char *line, size_t length) {
+    char *block = NULL;
+    size_t used = 0;
+    cmdLine *stage;
+    char *masked;
+
+    append(&block, &used, line, length);
+
+    /* the shell finds the here-documents of the line in its masked parse, so does the reader */
+    masked = strndup(line, length);
+    maskSubstitutions(masked);
+    stage = nextHereStage(parseCmdLinesR(ctx, masked));
+    free(masked);
+
+    for (; stage != NULL; stage = nextHereStage(stage->next))
+        if (!readBody(stage->hereDelimiter, &block, &used, 1))
+            break;
+
+    parserReset(ctx);
+    return block;
+}
+
+static void *readAhead(void *arg) {
+    parserContext ctx;
+    ssize_t n;
+
+    parserInit(&ctx);
+
+    while ((n = getline(&text, &text_size, script)) > 0) {
+        scriptLine line = {NULL, NULL, 0};
+
+        if (needsExpansion(text)) {
+            line.raw = rawBlock(&ctx, text, n);
+            cacheAddRaw(&writer, line.raw);
+        } else if ((line.command = parseCmdLines(text)) != NULL) {
+            restoreLiterals(line.command);
+            attachBodies(line.command);
+            cacheAddCommand(&writer, line.command);
+        } else
+            continue;
+
+        if (!push(&line)) {
+            freeCmdLines(line.command);
+            memFree(line.raw);
+            break;
+        }
+    }
+
+    /* only a script read to its end is worth a cache */
+    if (n <= 0 && cache_path[0])
+        cacheWriterSave(&writer, cache_path, script_hash, script_size);
+
+    cacheWriterFree(&writer);
+    parserDestroy(&ctx);
+    free(text);
+    fclose(script);
+
+    pthread_mutex_lock(&queue_lock);
+    script_done = 1;
+    wakeShell();
+    pthread_mutex_unlock(&queue_lock);
+    return NULL;
+}
+
+/* maps the whole script: it is hashed for the cache key and then read from memory */
+static int mapScript(const char *path) {
+    struct stat st;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) == -1 || fstat(fd, &st) == -1) {
+        perror(path);
+        if (fd != -1)
+            close(fd);
+        return -1;
+    }
+
+    script_size = st.st_size;
+    if (script_size > 0 && (script_data = mmap(NULL, script_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    script_hash = cacheHash(script_data, script_size);
+    return 0;
+}
+
+int scriptOpen(const char *path) {
+    if (mapScript(path) == -1)
+        return -1;
+
+    if ((ready_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) == -1) {
+        perror("eventfd");
+        return -1;
+    }
+
+    if (cachePath(script_hash, cache_path, sizeof(cache_path)) == -1)
+        cache_path[0] = 0;
+    else if (cacheOpen(&cache, cache_path, script_hash, script_size) == 0) {
+        from_cache = 1;
+        wakeShell();
+        return ready_fd;
+    }
+
+    /* fmemopen can't open an empty buffer, an empty script is over at once */
+    if (script_size == 0) {
+        script_done = 1;
+        wakeShell();
+        return ready_fd;
+    }
+
+    if ((script = fmemopen(script_data, script_size, "r")) == NULL) {
+        perror(path);
+        return -1;
+    }
+
+    cacheWriterInit(&writer);
+    if ((errno = pthread_create(&reader, NULL, readAhead, NULL)) != 0) {
+        perror("script reader");
+        fclose(script);
+        return -1;
+    }
+    reader_started = 1;
+
+    return ready_fd;
+}
+
+void scriptClose(void) {
+    if (!reader_started)
+        return;
+
+    pthread_mutex_lock(&queue_lock);
+    script_closing = 1;
+    pthread_cond_signal(&queue_not_full);
+    pthread_mutex_unlock(&queue_lock);
+
+    pthread_join(reader, NULL);
+    reader_started = 0;
+}
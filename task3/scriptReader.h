@@ -0,0 +1,32 @@
+//
+// Script mode (`myShell3 script`): a reader thread reads and parses the script ahead of the shell into a
+// bounded queue, so the shell only launches and waits. Lines that need expansion run commands while
+// they are expanded, they stay raw and go through the shell's usual runLine path in order.
+//
+
+#ifndef LAB6_SCRIPTREADER_H
+#define LAB6_SCRIPTREADER_H
+
+#include "LineParser.h"
+
+#define SCRIPT_QUEUE_SIZE 64
+
+typedef struct scriptLine {
+    cmdLine *command;       /* parsed ahead with its here-documents attached, NULL when raw is set */
+    char *raw;              /* a line needing expansion followed by the lines of its here-documents */
+    int rawMapped;          /* raw points into the script cache and is not freed */
+} scriptLine;
+
+/* Opens path and starts the reader thread, or maps the precompiled form of the script (see scriptCache.h) */
+/* A reader that gets to the end of the script leaves a precompiled form for the next runs */
+/* Returns an eventfd that is readable while lines are queued or once the script is over, -1 on failure */
+int scriptOpen(const char *path);
+
+/* Stops the reader before the shell exits. A reader still writing the cache finishes first */
+void scriptClose(void);
+
+/* Takes the next line without blocking. The caller owns command, and raw unless rawMapped (memFree) */
+/* Returns 1 when *line was filled, 0 when the reader has not caught up yet, -1 at the end of the script */
+int scriptNext(scriptLine *line);
+
+#endif //LAB6_SCRIPTREADER_H
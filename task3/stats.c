@@ -0,0 +1,183 @@
+#define _GNU_SOURCE
+#include "stats.h"
+#include "memstat.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/wait.h>
+
+/* open addressing on the command name, allocated on first use; the last slot collects the overflow */
+static commandStats *table[MAX_STAT_COMMANDS];
+
+long long statsNow(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int msb(unsigned long long value) {
+    return 63 - __builtin_clzll(value);
+}
+
+/* below HIST_SUB the buckets are exact, above each power of two is cut in HIST_SUB equal parts */
+static int bucketOf(unsigned long long value) {
+    int shift, index;
+
+    if (value < HIST_SUB)
+        return (int) value;
+
+    shift = msb(value) - HIST_SUB_BITS;
+    index = HIST_SUB + shift * HIST_SUB + (int) ((value >> shift) - HIST_SUB);
+    return index < HIST_BUCKETS ? index : HIST_BUCKETS - 1;
+}
+
+static unsigned long long bucketTop(int index) {
+    int shift;
+
+    if (index < HIST_SUB)
+        return index;
+
+    shift = (index - HIST_SUB) / HIST_SUB;
+    return (((unsigned long long) (HIST_SUB + (index - HIST_SUB) % HIST_SUB) + 1) << shift) - 1;
+}
+
+void histogramRecord(histogram *h, unsigned long long value) {
+    h->buckets[bucketOf(value)]++;
+    h->count++;
+    if (value > h->max)
+        h->max = value;
+}
+
+unsigned long long histogramQuantile(const histogram *h, double q) {
+    unsigned long long rank = (unsigned long long) (q * h->count + 0.5), seen = 0;
+    int i;
+
+    if (h->count == 0)
+        return 0;
+    if (rank < 1)
+        rank = 1;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank)
+            return bucketTop(i) < h->max ? bucketTop(i) : h->max;
+    }
+
+    return h->max;
+}
+
+static unsigned long hashName(const char *name) {
+    unsigned long hash = 2166136261u;
+
+    for (; *name; name++)
+        hash = (hash ^ (unsigned char) *name) * 16777619u;
+    return hash;
+}
+
+static commandStats *lookup(const char *name) {
+    unsigned long slot = hashName(name) % (MAX_STAT_COMMANDS - 1);
+    int probes;
+
+    for (probes = 0; probes < MAX_STAT_COMMANDS - 1; probes++, slot = (slot + 1) % (MAX_STAT_COMMANDS - 1)) {
+        if (table[slot] == NULL) {
+            table[slot] = memCalloc(MEM_STATS, 1, sizeof(commandStats));
+            strncpy(table[slot]->name, name, STAT_NAME_SIZE - 1);
+            return table[slot];
+        }
+        if (strncmp(table[slot]->name, name, STAT_NAME_SIZE - 1) == 0)
+            return table[slot];
+    }
+
+    if (table[MAX_STAT_COMMANDS - 1] == NULL) {
+        table[MAX_STAT_COMMANDS - 1] = memCalloc(MEM_STATS, 1, sizeof(commandStats));
+        strcpy(table[MAX_STAT_COMMANDS - 1]->name, "(other)");
+    }
+    return table[MAX_STAT_COMMANDS - 1];
+}
+
+void statsRecord(const char *name, long long spawnNs, long long execNs, long long exitNs, int waitStatus) {
+    commandStats *s = lookup(name);
+
+    s->runs++;
+
+    if (execNs == 0)
+        s->execFailures++;
+    else {
+        histogramRecord(&s->spawn, (execNs - spawnNs) / 1000);
+        histogramRecord(&s->run, (exitNs - execNs) / 1000);
+    }
+
+    if (WIFEXITED(waitStatus))
+        s->exits[WEXITSTATUS(waitStatus)]++;
+    else if (WIFSIGNALED(waitStatus) && WTERMSIG(waitStatus) < 65)
+        s->signals[WTERMSIG(waitStatus)]++;
+}
+
+static const char *formatMicros(unsigned long long us, char *buffer, size_t size) {
+    if (us < 10000)
+        snprintf(buffer, size, "%lluus", us);
+    else if (us < 10000000)
+        snprintf(buffer, size, "%.1fms", us / 1e3);
+    else
+        snprintf(buffer, size, "%.1fs", us / 1e6);
+    return buffer;
+}
+
+static void printLatency(const histogram *h) {
+    char p50[16], p99[16], max[16];
+
+    if (h->count == 0) {
+        printf("%8s %8s %8s  ", "-", "-", "-");
+        return;
+    }
+
+    printf("%8s %8s %8s  ", formatMicros(histogramQuantile(h, 0.5), p50, sizeof(p50)),
+           formatMicros(histogramQuantile(h, 0.99), p99, sizeof(p99)), formatMicros(h->max, max, sizeof(max)));
+}
+
+static int compareStats(const void *a, const void *b) {
+    const commandStats *x = *(commandStats *const *) a, *y = *(commandStats *const *) b;
+    return x->runs < y->runs ? 1 : x->runs > y->runs ? -1 : strcmp(x->name, y->name);
+}
+
+void printStats(void) {
+    commandStats *sorted[MAX_STAT_COMMANDS];
+    int count = 0, i, code;
+
+    for (i = 0; i < MAX_STAT_COMMANDS; i++)
+        if (table[i] != NULL)
+            sorted[count++] = table[i];
+    qsort(sorted, count, sizeof(commandStats *), compareStats);
+
+    printf("%-16s %6s  %8s %8s %8s  %8s %8s %8s  %s\n", "COMMAND", "RUNS",
+           "SPAWN50", "SPAWN99", "MAX", "RUN50", "RUN99", "MAX", "EXIT");
+
+    for (i = 0; i < count; i++) {
+        commandStats *s = sorted[i];
+
+        printf("%-16s %6lu  ", s->name, s->runs);
+        printLatency(&s->spawn);
+        printLatency(&s->run);
+
+        for (code = 0; code < 256; code++)
+            if (s->exits[code])
+                printf(" %d:%u", code, s->exits[code]);
+        for (code = 1; code < 65; code++)
+            if (s->signals[code])
+                printf(" SIG%s:%u", sigabbrev_np(code) ? sigabbrev_np(code) : "?", s->signals[code]);
+        if (s->execFailures)
+            printf(" (%lu exec failed)", s->execFailures);
+        printf("\n");
+    }
+}
+
+void statsReset(void) {
+    int i;
+
+    for (i = 0; i < MAX_STAT_COMMANDS; i++) {
+        memFree(table[i]);
+        table[i] = NULL;
+    }
+}
@@ -0,0 +1,46 @@
+//
+// Per-command statistics for the stats builtin: run count, exit statuses and log-linear (HDR-style)
+// histograms of the spawn-to-exec and exec-to-exit latencies, in fixed memory per command.
+//
+
+#ifndef LAB6_STATS_H
+#define LAB6_STATS_H
+
+#define HIST_SUB_BITS 4                                 /* 16 linear buckets per power of two: ~6% error */
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (HIST_SUB + 32 * HIST_SUB)         /* microseconds up to about 2^36 (19 hours) */
+#define MAX_STAT_COMMANDS 128
+#define STAT_NAME_SIZE 32
+
+typedef struct histogram {
+    unsigned long long count;
+    unsigned long long max;
+    unsigned int buckets[HIST_BUCKETS];
+} histogram;
+
+typedef struct commandStats {
+    char name[STAT_NAME_SIZE];
+    unsigned long runs;
+    unsigned long execFailures;     /* exec failed, no spawn latency recorded */
+    histogram spawn;                /* fork to successful exec, us */
+    histogram run;                  /* exec to exit, us */
+    unsigned int exits[256];        /* exit codes */
+    unsigned int signals[65];       /* terminating signals */
+} commandStats;
+
+long long statsNow(void);          /* CLOCK_MONOTONIC in ns */
+
+void histogramRecord(histogram *h, unsigned long long value);
+
+/* Value at or below which a fraction q of the recorded values lie (bucket upper bound) */
+unsigned long long histogramQuantile(const histogram *h, double q);
+
+/* Records one finished process. execNs is 0 when the exec failed */
+void statsRecord(const char *name, long long spawnNs, long long execNs, long long exitNs, int waitStatus);
+
+/* Prints runs, p50/p99/max of both latencies and the exit statuses of every command seen */
+void printStats(void);
+
+void statsReset(void);
+
+#endif //LAB6_STATS_H
@@ -0,0 +1,188 @@
+#define _GNU_SOURCE
+#include "topology.h"
+#include "schedAttrs.h"
+#include "memstat.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+
+typedef struct cpuInfo {
+    int cpu;
+    int l2;         /* lowest cpu sharing this cpu's L2, i.e. the domain id */
+    int l3;
+    int load;       /* stages currently pinned here by the shell */
+} cpuInfo;
+
+static cpuInfo *cpus = NULL;    /* sorted by l3, l2, cpu: neighbours in the array share caches */
+static int ncpus = 0;
+static int loaded = 0;
+
+static int readLine(const char *path, char *buf, int size) {
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL)
+        return -1;
+
+    if (fgets(buf, size, file) == NULL) {
+        fclose(file);
+        return -1;
+    }
+    fclose(file);
+
+    buf[strcspn(buf, "\n")] = 0;
+    return 0;
+}
+
+static int firstCpu(const char *list) {
+    return (int) strtol(list, NULL, 10);
+}
+
+static void readCaches(cpuInfo *info) {
+    char path[128], value[256];
+    int index;
+
+    info->l2 = info->cpu;
+    info->l3 = -1;
+
+    for (index = 0; index < 8; index++) {
+        int level;
+
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/level", info->cpu, index);
+        if (readLine(path, value, sizeof(value)) == -1)
+            break;
+        level = atoi(value);
+
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/type", info->cpu, index);
+        if (readLine(path, value, sizeof(value)) == -1 || strcmp(value, "Instruction") == 0)
+            continue;
+
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/cache/index%d/shared_cpu_list", info->cpu, index);
+        if (readLine(path, value, sizeof(value)) == -1)
+            continue;
+
+        if (level == 2)
+            info->l2 = firstCpu(value);
+        else if (level == 3)
+            info->l3 = firstCpu(value);
+    }
+
+    /* no L3 reported: the package is the closest shared level */
+    if (info->l3 == -1) {
+        snprintf(path, sizeof(path), SYSFS_CPU "/cpu%d/topology/physical_package_id", info->cpu);
+        info->l3 = readLine(path, value, sizeof(value)) == 0 ? atoi(value) : 0;
+    }
+}
+
+static int compareCpus(const void *a, const void *b) {
+    const cpuInfo *x = a, *y = b;
+
+    if (x->l3 != y->l3)
+        return x->l3 - y->l3;
+    if (x->l2 != y->l2)
+        return x->l2 - y->l2;
+    return x->cpu - y->cpu;
+}
+
+int topologyLoad(void) {
+    char online[1024];
+    cpu_set_t set, allowed;
+    int cpu;
+
+    if (loaded)
+        return ncpus;
+    loaded = 1;
+
+    if (readLine(SYSFS_CPU "/online", online, sizeof(online)) == -1 || parseCpuList(online, &set) == -1)
+        return -1;
+
+    /* never place outside the shell's own affinity mask */
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+        CPU_AND(&set, &set, &allowed);
+
+    cpus = memCalloc(MEM_TOPOLOGY, CPU_COUNT(&set), sizeof(cpuInfo));
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &set))
+            continue;
+        cpus[ncpus].cpu = cpu;
+        readCaches(&cpus[ncpus++]);
+    }
+
+    qsort(cpus, ncpus, sizeof(cpuInfo), compareCpus);
+    return ncpus;
+}
+
+int topologyPlace(int stages, int *placed) {
+    int best_domain = -1, best_size = 1, best_start = 0;
+    long best_domain_load = LONG_MAX, best_window = LONG_MAX;
+    int first, end = 0, size, start, i;
+
+    if (topologyLoad() <= 0)
+        return -1;
+
+    /* least loaded L3 domain per cpu, lowest id on ties */
+    for (first = 0; first < ncpus; first = end) {
+        long load = 0;
+
+        for (end = first; end < ncpus && cpus[end].l3 == cpus[first].l3; end++)
+            load += cpus[end].load;
+
+        /* compare load / size without dividing */
+        if (best_domain == -1 || load * best_size < best_domain_load * (end - first)) {
+            best_domain = first;
+            best_size = end - first;
+            best_domain_load = load;
+        }
+    }
+
+    size = best_size;
+
+    /* inside the domain: the least loaded window of consecutive cpus, starting on an L2 boundary if possible */
+    for (start = 0; start < size; start++) {
+        long window = 0;
+        int boundary = start == 0 || cpus[best_domain + start].l2 != cpus[best_domain + start - 1].l2;
+
+        for (i = 0; i < stages; i++)
+            window += cpus[best_domain + (start + i) % size].load;
+
+        window = window * 2 + !boundary;
+        if (window < best_window) {
+            best_window = window;
+            best_start = start;
+        }
+    }
+
+    for (i = 0; i < stages; i++) {
+        cpuInfo *info = &cpus[best_domain + (best_start + i) % size];
+        info->load++;
+        placed[i] = info->cpu;
+    }
+
+    return 0;
+}
+
+void topologyRelease(int cpu) {
+    int i;
+
+    for (i = 0; i < ncpus; i++)
+        if (cpus[i].cpu == cpu) {
+            if (cpus[i].load > 0)
+                cpus[i].load--;
+            return;
+        }
+}
+
+void printTopology(void) {
+    int i;
+
+    if (topologyLoad() <= 0) {
+        fprintf(stderr, "topology: can't read " SYSFS_CPU "\n");
+        return;
+    }
+
+    printf("CPU\tL2\tL3\tSTAGES\n");
+    for (i = 0; i < ncpus; i++)
+        printf("%d\t%d\t%d\t%d\n", cpus[i].cpu, cpus[i].l2, cpus[i].l3, cpus[i].load);
+}
@@ -0,0 +1,21 @@
+//
+// CPU cache topology from /sys/devices/system/cpu, used by `set topology on` to place pipeline stages.
+//
+
+#ifndef LAB6_TOPOLOGY_H
+#define LAB6_TOPOLOGY_H
+
+/* Reads the topology once. Returns the number of online cpus, -1 when sysfs can't be read */
+int topologyLoad(void);
+
+/* Picks a cpu for each of the stages: neighbours share an L2 (else an L3) cache, */
+/* and the least loaded cache domain is used so independent jobs spread out. */
+/* The chosen cpus are reserved until topologyRelease. Returns 0 on success, -1 without topology */
+int topologyPlace(int stages, int *cpus);
+
+void topologyRelease(int cpu);
+
+/* Prints the cpus in placement order with their L2/L3 domains and current load */
+void printTopology(void);
+
+#endif //LAB6_TOPOLOGY_H
@@ -0,0 +1,124 @@
+#define _GNU_SOURCE
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+typedef struct traceRing {
+    unsigned long head;             /* total number of events recorded, bumped atomically */
+    traceEvent events[TRACE_EVENTS];
+} traceRing;
+
+static traceRing *ring = NULL;
+
+static const char *type_names[] = {"fork", "exec", "pipe", "dup2", "wait", "signal", "debug"};
+
+void traceInit(void) {
+    /* shared: children record their dup2 and exec into the same ring until they exec */
+    void *mem = mmap(NULL, sizeof(traceRing), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if (mem == MAP_FAILED)
+        perror("trace: mmap failed");
+    else
+        ring = mem;
+}
+
+void traceRecord(int type, pid_t pid, pid_t group, int arg, const char *label) {
+    struct timespec ts;
+    traceEvent *e;
+
+    if (ring == NULL)
+        return;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    e = &ring->events[__atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED) % TRACE_EVENTS];
+
+    e->ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    e->type = type;
+    e->pid = pid;
+    e->group = group;
+    e->arg = arg;
+    strncpy(e->label, label ? label : "", TRACE_LABEL_SIZE - 1);
+    e->label[TRACE_LABEL_SIZE - 1] = 0;
+}
+
+void traceClear(void) {
+    if (ring != NULL)
+        __atomic_store_n(&ring->head, 0, __ATOMIC_RELAXED);
+}
+
+unsigned long traceCount(void) {
+    unsigned long head = ring ? __atomic_load_n(&ring->head, __ATOMIC_RELAXED) : 0;
+
+    return head < TRACE_EVENTS ? head : TRACE_EVENTS;
+}
+
+static void writeString(FILE *out, const char *str) {
+    fputc('"', out);
+    for (; *str; str++) {
+        if (*str == '"' || *str == '\\')
+            fprintf(out, "\\%c", *str);
+        else if ((unsigned char) *str < 0x20)
+            fprintf(out, "\\u%04x", *str);
+        else
+            fputc(*str, out);
+    }
+    fputc('"', out);
+}
+
+/* a process is a slice from its fork to its exit, on the row of its job; everything else is an instant */
+static void writeEvent(FILE *out, const traceEvent *e, pid_t shell) {
+    const char *phase = "i";
+    pid_t pid = e->pid > 0 ? e->pid : shell;
+    pid_t group = e->group > 0 ? e->group : shell;
+
+    if (e->type == TRACE_FORK)
+        phase = "B";
+    else if (e->type == TRACE_WAIT && (WIFEXITED(e->arg) || WIFSIGNALED(e->arg)))
+        phase = "E";
+
+    fprintf(out, "{\"name\":");
+    writeString(out, e->label[0] ? e->label : type_names[e->type]);
+    fprintf(out, ",\"cat\":\"%s\",\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,",
+            type_names[e->type], phase, e->ns / 1000.0, group, pid);
+    if (*phase == 'i')
+        fprintf(out, "\"s\":\"t\",");
+    fprintf(out, "\"args\":{\"arg\":%d}}", e->arg);
+}
+
+int traceDump(const char *path) {
+    FILE *out;
+    unsigned long head, i, first;
+    pid_t shell = getpid();
+
+    if (ring == NULL) {
+        fprintf(stderr, "trace: no trace buffer\n");
+        return -1;
+    }
+
+    if ((out = fopen(path, "w")) == NULL) {
+        perror("trace: can't open the dump file");
+        return -1;
+    }
+
+    head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    first = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0;
+
+    fprintf(out, "{\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"shell\"}}", shell);
+    for (i = first; i < head; i++) {
+        fprintf(out, ",\n");
+        writeEvent(out, &ring->events[i % TRACE_EVENTS], shell);
+    }
+    fprintf(out, "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+    if (fclose(out) == EOF) {
+        perror("trace: failed to write the dump");
+        return -1;
+    }
+
+    return 0;
+}
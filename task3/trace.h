@@ -0,0 +1,51 @@
+//
+// Event tracer: fork, exec, pipe, dup2, wait and signal events go into a preallocated ring buffer
+// shared with the children (so exec and dup2 are seen from their side), `trace dump` writes Chrome trace JSON.
+//
+
+#ifndef LAB6_TRACE_H
+#define LAB6_TRACE_H
+
+#include "options.h"
+#include <sys/types.h>
+
+#define TRACE_EVENTS 65536         /* ring size, the oldest events are overwritten */
+#define TRACE_LABEL_SIZE 40
+
+enum traceType {
+    TRACE_FORK,     /* pid started (parent side), label is the command */
+    TRACE_EXEC,     /* pid about to exec the label (child side) */
+    TRACE_PIPE,     /* arg pipes created for a chain */
+    TRACE_DUP2,     /* pid moved label onto fd arg (child side) */
+    TRACE_WAIT,     /* pid reaped or stopped/continued, arg is the raw wait status */
+    TRACE_SIGNAL,   /* signal arg received by the shell (pid -1) or sent to pid */
+    TRACE_DEBUG,    /* a printDebug message */
+};
+
+typedef struct traceEvent {
+    unsigned long long ns;          /* CLOCK_MONOTONIC */
+    int type;
+    pid_t pid;                      /* process the event is about, -1 for the shell itself */
+    pid_t group;                    /* its process group: the job in the timeline */
+    int arg;
+    char label[TRACE_LABEL_SIZE];
+} traceEvent;
+
+/* With `set trace off` an event costs the test of options.trace */
+#define TRACE(type, pid, group, arg, label) \
+    do { if (__builtin_expect(options.trace, 0)) traceRecord(type, pid, group, arg, label); } while (0)
+
+/* Maps the ring buffer once at startup, before any child is forked */
+void traceInit(void);
+
+void traceRecord(int type, pid_t pid, pid_t group, int arg, const char *label);
+
+void traceClear(void);
+
+/* Number of events in the ring */
+unsigned long traceCount(void);
+
+/* Writes the ring as Chrome trace-event JSON (chrome://tracing, Perfetto). Returns 0 on success, -1 on error */
+int traceDump(const char *path);
+
+#endif //LAB6_TRACE_H
@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+#include "variables.h"
+#include "memstat.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+typedef struct variable {
+    char *text;             /* "NAME=value", NULL in a free slot */
+    uint32_t hash;
+    uint32_t nameLength;
+    char exported;
+} variable;
+
+static variable *slots = NULL;
+static size_t capacity = 0, used = 0;
+
+/* exported strings copied into one block: the pointer array, then the strings */
+static char **environment_block = NULL;
+static int environment_stale = 1;
+
+static uint32_t hashName(const char *name, size_t length) {
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < length; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* slot holding name, or the free slot ending its probe run */
+static size_t findSlot(const char *name, size_t length, uint32_t hash) {
+    size_t mask = capacity - 1, i = hash & mask;
+
+    while (slots[i].text != NULL
+           && !(slots[i].hash == hash && slots[i].nameLength == length && memcmp(slots[i].text, name, length) == 0))
+        i = (i + 1) & mask;
+    return i;
+}
+
+static void grow(void) {
+    variable *old = slots;
+    size_t old_capacity = capacity, i, j;
+
+    capacity = capacity ? capacity * 2 : VARIABLES_MIN_CAPACITY;
+    slots = memCalloc(MEM_VARIABLES, capacity, sizeof(variable));
+
+    for (i = 0; i < old_capacity; i++) {
+        if (old[i].text == NULL)
+            continue;
+        for (j = old[i].hash & (capacity - 1); slots[j].text != NULL; j = (j + 1) & (capacity - 1));
+        slots[j] = old[i];
+    }
+    memFree(old);
+}
+
+/* the variable of name, created empty and not exported when missing */
+static variable *lookupOrAdd(const char *name, size_t length) {
+    uint32_t hash = hashName(name, length);
+    variable *v;
+
+    if ((used + 1) * 4 > capacity * 3)
+        grow();
+
+    v = &slots[findSlot(name, length, hash)];
+    if (v->text == NULL) {
+        v->text = memAlloc(MEM_VARIABLES, length + 2);
+        memcpy(v->text, name, length);
+        v->text[length] = '=';
+        v->text[length + 1] = 0;
+        v->hash = hash;
+        v->nameLength = length;
+        v->exported = 0;
+        used++;
+    }
+    return v;
+}
+
+static void setValue(variable *v, const char *value) {
+    size_t length = strlen(value);
+
+    v->text = memRealloc(MEM_VARIABLES, v->text, v->nameLength + length + 2);
+    memcpy(v->text + v->nameLength + 1, value, length + 1);
+    if (v->exported)
+        environment_stale = 1;
+}
+
+void varsInit(char *const *environment) {
+    char *const *entry;
+
+    /* names a shell could not assign are passed on to the commands all the same */
+    for (entry = environment; entry != NULL && *entry != NULL; entry++) {
+        const char *equals = strchr(*entry, '=');
+        variable *v;
+
+        if (equals == NULL || equals == *entry)
+            continue;
+
+        v = lookupOrAdd(*entry, equals - *entry);
+        v->exported = 1;
+        setValue(v, equals + 1);
+    }
+}
+
+int varValidName(const char *name, size_t length) {
+    size_t i;
+
+    if (length == 0 || !(name[0] == '_' || (name[0] >= 'a' && name[0] <= 'z') || (name[0] >= 'A' && name[0] <= 'Z')))
+        return 0;
+
+    for (i = 1; i < length; i++)
+        if (!(name[i] == '_' || (name[i] >= 'a' && name[i] <= 'z') || (name[i] >= 'A' && name[i] <= 'Z')
+              || (name[i] >= '0' && name[i] <= '9')))
+            return 0;
+    return 1;
+}
+
+const char *varGet(const char *name, size_t length) {
+    variable *v;
+
+    if (capacity == 0)
+        return NULL;
+
+    v = &slots[findSlot(name, length, hashName(name, length))];
+    return v->text != NULL ? v->text + v->nameLength + 1 : NULL;
+}
+
+int varSet(const char *name, size_t length, const char *value) {
+    if (!varValidName(name, length))
+        return -1;
+
+    setValue(lookupOrAdd(name, length), value);
+    return 0;
+}
+
+int varExport(const char *name, size_t length) {
+    variable *v;
+
+    if (!varValidName(name, length))
+        return -1;
+
+    v = lookupOrAdd(name, length);
+    if (!v->exported) {
+        v->exported = 1;
+        environment_stale = 1;
+    }
+    return 0;
+}
+
+int varUnset(const char *name, size_t length) {
+    size_t mask, i, j, home;
+
+    if (capacity == 0)
+        return 0;
+
+    mask = capacity - 1;
+    i = findSlot(name, length, hashName(name, length));
+    if (slots[i].text == NULL)
+        return 0;
+
+    if (slots[i].exported)
+        environment_stale = 1;
+    memFree(slots[i].text);
+    slots[i].text = NULL;
+    used--;
+
+    /* no tombstones: the rest of the probe run moves back into the hole when its home slot allows it */
+    for (j = (i + 1) & mask; slots[j].text != NULL; j = (j + 1) & mask) {
+        home = slots[j].hash & mask;
+
+        if (i <= j ? (home <= i || home > j) : (home <= i && home > j)) {
+            slots[i] = slots[j];
+            slots[j].text = NULL;
+            i = j;
+        }
+    }
+    return 1;
+}
+
+char *const *varEnvironment(void) {
+    size_t count = 0, bytes = 0, i;
+    char *strings;
+
+    if (!environment_stale)
+        return environment_block;
+
+    for (i = 0; i < capacity; i++) {
+        if (slots[i].text != NULL && slots[i].exported) {
+            count++;
+            bytes += strlen(slots[i].text) + 1;
+        }
+    }
+
+    memFree(environment_block);
+    environment_block = memAlloc(MEM_VARIABLES, (count + 1) * sizeof(char *) + bytes);
+    strings = (char *) (environment_block + count + 1);
+
+    for (count = 0, i = 0; i < capacity; i++) {
+        if (slots[i].text != NULL && slots[i].exported) {
+            environment_block[count++] = strings;
+            strings = stpcpy(strings, slots[i].text) + 1;
+        }
+    }
+    environment_block[count] = NULL;
+
+    environment_stale = 0;
+    return environment_block;
+}
+
+void varsFree(void) {
+    size_t i;
+
+    for (i = 0; i < capacity; i++)
+        memFree(slots[i].text);
+    memFree(slots);
+    memFree(environment_block);
+
+    slots = NULL;
+    environment_block = NULL;
+    capacity = used = 0;
+    environment_stale = 1;
+}
@@ -0,0 +1,39 @@
+//
+// Shell variables: one open-addressing hash table (linear probing, FNV-1a) of "NAME=value" strings, the
+// environment the shell started with included. Exported ones are packed into one envp block for exec, which
+// is rebuilt on the first launch after an exported variable changed, not on every exec.
+//
+
+#ifndef LAB6_VARIABLES_H
+#define LAB6_VARIABLES_H
+
+#include <stddef.h>
+
+#define VARIABLES_MIN_CAPACITY 256      /* slots, a power of two, at most 3/4 of them used */
+
+/* Fills the table from environment (NAME=value strings, NULL terminated), everything exported */
+void varsInit(char *const *environment);
+
+/* 1 when the length bytes of name are [A-Za-z_][A-Za-z0-9_]* */
+int varValidName(const char *name, size_t length);
+
+/* Value of the variable named by the length bytes of name, NULL when it is not set */
+const char *varGet(const char *name, size_t length);
+
+/* Sets a variable, a new one is not exported, an existing one keeps its export flag */
+/* Returns 0 on success, -1 when name is not valid */
+int varSet(const char *name, size_t length, const char *value);
+
+/* Marks a variable exported (an unset one is created empty) */
+/* Returns 0 on success, -1 when name is not valid */
+int varExport(const char *name, size_t length);
+
+/* Returns 1 when it was set, 0 otherwise */
+int varUnset(const char *name, size_t length);
+
+/* The exported variables as an envp array, valid until the next change to one of them */
+char *const *varEnvironment(void);
+
+void varsFree(void);
+
+#endif //LAB6_VARIABLES_H
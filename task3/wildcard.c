@@ -0,0 +1,420 @@
+#define _GNU_SOURCE
+#include "wildcard.h"
+#include "memstat.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/limits.h>
+
+#define INSERTION_SORT_SIZE 16
+
+enum { OP_CHAR, OP_ANY, OP_STAR, OP_CLASS };
+
+typedef struct matchOp {
+    unsigned char kind;
+    unsigned char c;        /* OP_CHAR */
+    uint8_t set[32];        /* OP_CLASS: bit per byte value */
+} matchOp;
+
+/* one compiled path component: prefix, matcher ops, suffix */
+typedef struct matcher {
+    const char *prefix, *suffix;    /* point into the pattern */
+    size_t prefixLength, suffixLength;
+    matchOp *ops, *middle;          /* ops is the allocation, middle what is left between prefix and suffix */
+    size_t count;
+    int dotted;                     /* starts with a literal '.', hidden names may match */
+} matcher;
+
+/* what the getdents64 syscall fills in */
+typedef struct linuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} linuxDirent64;
+
+typedef struct walk {
+    arena *out;
+    wildcardMatches *matches;
+    char *dents;            /* WILDCARD_DENTS_SIZE bytes, one directory read at a time */
+} walk;
+
+/* ----- Compiling and matching ----- */
+/* a [ starts a class only when a ] closes it */
+static int isWild(const char *p, size_t length) {
+    size_t i;
+
+    for (i = 0; i < length; i++)
+        if (p[i] == '*' || p[i] == '?' || (p[i] == '[' && memchr(p + i + 1, ']', length - i - 1) != NULL))
+            return 1;
+    return 0;
+}
+
+int hasWildcards(const char *word) {
+    return isWild(word, strlen(word));
+}
+
+/* Returns the length of the class at p, '[' and ']' included, 0 when nothing closes it */
+static size_t compileClass(const char *p, size_t length, uint8_t *set) {
+    size_t i = 1, start, j;
+    int negate = 0;
+
+    memset(set, 0, 32);
+    if (i < length && (p[i] == '!' || p[i] == '^')) {
+        negate = 1;
+        i++;
+    }
+
+    /* a ] right after [ or [! is one of the members */
+    for (start = i; i < length && (p[i] != ']' || i == start); i++) {
+        unsigned lo = (unsigned char) p[i], hi = lo, c;
+
+        if (i + 2 < length && p[i + 1] == '-' && p[i + 2] != ']') {
+            hi = (unsigned char) p[i + 2];
+            i += 2;
+        }
+        for (c = lo; c <= hi; c++)
+            set[c >> 3] |= 1 << (c & 7);
+    }
+
+    if (i >= length)
+        return 0;
+
+    if (negate)
+        for (j = 0; j < 32; j++)
+            set[j] = ~set[j];
+    return i + 1;
+}
+
+static void compile(const char *p, size_t length, matcher *m) {
+    size_t i = 0, n, count = 0, first, last;
+    matchOp *ops = memAlloc(MEM_LINES, (length + 1) * sizeof(matchOp));
+
+    while (i < length) {
+        matchOp *op = &ops[count];
+
+        if (p[i] == '*') {
+            /* ** is *, one backtracking point is enough */
+            if (count == 0 || ops[count - 1].kind != OP_STAR)
+                ops[count++].kind = OP_STAR;
+            i++;
+        } else if (p[i] == '?') {
+            op->kind = OP_ANY;
+            count++;
+            i++;
+        } else if (p[i] == '[' && (n = compileClass(p + i, length - i, op->set)) > 0) {
+            op->kind = OP_CLASS;
+            count++;
+            i += n;
+        } else {
+            op->kind = OP_CHAR;
+            op->c = (unsigned char) p[i];
+            count++;
+            i++;
+        }
+    }
+
+    /* literal ops at either end are single pattern bytes at either end of p */
+    for (first = 0; first < count && ops[first].kind == OP_CHAR; first++);
+    for (last = count; last > first && ops[last - 1].kind == OP_CHAR; last--);
+
+    m->prefix = p;
+    m->prefixLength = first;
+    m->suffixLength = count - last;
+    m->suffix = p + length - m->suffixLength;
+    m->ops = ops;
+    m->middle = ops + first;
+    m->count = last - first;
+    m->dotted = p[0] == '.';
+}
+
+static int matchOne(const matchOp *op, unsigned char c) {
+    switch (op->kind) {
+        case OP_ANY:
+            return 1;
+        case OP_CLASS:
+            return op->set[c >> 3] >> (c & 7) & 1;
+        default:
+            return op->c == c;
+    }
+}
+
+/* greedy, backtracking only to the last * passed: enough for patterns where * is the only repetition */
+static int matchOps(const matchOp *op, size_t count, const char *s, const char *end) {
+    const matchOp *ops_end = op + count, *star = NULL;
+    const char *resume = NULL;
+
+    while (s < end) {
+        if (op < ops_end && op->kind == OP_STAR) {
+            if (++op == ops_end)
+                return 1;
+            star = op;
+            resume = s;
+            continue;
+        }
+        if (op < ops_end && matchOne(op, (unsigned char) *s)) {
+            op++;
+            s++;
+            continue;
+        }
+        if (star == NULL)
+            return 0;
+
+        /* the last * takes more bytes: up to where the literal after it occurs next */
+        resume++;
+        if (star->kind == OP_CHAR && (resume = memchr(resume, star->c, end - resume)) == NULL)
+            return 0;
+        op = star;
+        s = resume;
+    }
+
+    while (op < ops_end && op->kind == OP_STAR)
+        op++;
+    return op == ops_end;
+}
+
+static int matches(const matcher *m, const char *name, size_t length) {
+    if (length < m->prefixLength + m->suffixLength || memcmp(name, m->prefix, m->prefixLength) != 0
+        || memcmp(name + length - m->suffixLength, m->suffix, m->suffixLength) != 0)
+        return 0;
+
+    return matchOps(m->middle, m->count, name + m->prefixLength, name + length - m->suffixLength);
+}
+
+/* ----- Sorting ----- */
+static void swapStrings(const char **v, size_t i, size_t j) {
+    const char *t = v[i];
+
+    v[i] = v[j];
+    v[j] = t;
+}
+
+/* three-way radix quicksort: the n strings of v share their first depth bytes, they split on the next one */
+static void sortStrings(const char **v, size_t n, size_t depth) {
+    size_t i, j;
+
+    while (n > INSERTION_SORT_SIZE) {
+        size_t lt = 0, gt = n;
+        int pivot;
+
+        swapStrings(v, 0, n / 2);
+        pivot = (unsigned char) v[0][depth];
+
+        for (i = 1; i < gt;) {
+            int c = (unsigned char) v[i][depth];
+
+            if (c < pivot)
+                swapStrings(v, lt++, i++);
+            else if (c > pivot)
+                swapStrings(v, i, --gt);
+            else
+                i++;
+        }
+
+        sortStrings(v, lt, depth);
+        sortStrings(v + gt, n - gt, depth);
+
+        /* the equal ones go on with the next byte, unless they all ended here */
+        if (pivot == 0)
+            return;
+        v += lt;
+        n = gt - lt;
+        depth++;
+    }
+
+    for (i = 1; i < n; i++)
+        for (j = i; j > 0 && strcmp(v[j - 1] + depth, v[j] + depth) > 0; j--)
+            swapStrings(v, j - 1, j);
+}
+
+/* ----- Walking ----- */
+static void addOffset(wildcardMatches *m, size_t offset) {
+    if (m->count == m->capacity) {
+        m->capacity = m->capacity ? m->capacity * 2 : 64;
+        m->offsets = memRealloc(MEM_LINES, m->offsets, m->capacity * sizeof(size_t));
+    }
+    m->offsets[m->count++] = offset;
+}
+
+static void emit(walk *w, const char *path, size_t length, const char *name, size_t nameLength) {
+    arena *a = w->out;
+    size_t offset = a->used;
+
+    arenaReserve(a, length + nameLength + 1);
+    memcpy(a->data + a->used, path, length);
+    memcpy(a->data + a->used + length, name, nameLength);
+    a->data[a->used + length + nameLength] = 0;
+    a->used += length + nameLength + 1;
+    addOffset(w->matches, offset);
+}
+
+/* symlinks are followed, DT_UNKNOWN filesystems are asked */
+static int isDirectory(int dirfd, const char *name, unsigned char type) {
+    struct stat st;
+
+    if (type == DT_DIR)
+        return 1;
+    return (type == DT_LNK || type == DT_UNKNOWN) && fstatat(dirfd, name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void walkPattern(walk *w, char *path, size_t length, const char *pattern);
+
+/* matches the component against the directory path (length bytes), then walks the rest below each match */
+static void readComponent(walk *w, char *path, size_t length, const char *component, size_t componentLength,
+                          const char *rest) {
+    arena subdirs;
+    matcher m;
+    size_t at;
+    long n;
+    int fd;
+
+    if ((fd = open(length > 0 ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+        return;
+
+    compile(component, componentLength, &m);
+    arenaInit(&subdirs);
+
+    while ((n = syscall(SYS_getdents64, fd, w->dents, WILDCARD_DENTS_SIZE)) > 0) {
+        long offset;
+
+        for (offset = 0; offset < n; offset += ((linuxDirent64 *) (w->dents + offset))->d_reclen) {
+            linuxDirent64 *d = (linuxDirent64 *) (w->dents + offset);
+            const char *name = d->d_name;
+            size_t nameLength = strlen(name);
+
+            if (name[0] == '.' && (!m.dotted || nameLength == 1 || (nameLength == 2 && name[1] == '.')))
+                continue;
+            if (!matches(&m, name, nameLength))
+                continue;
+
+            if (rest == NULL)
+                emit(w, path, length, name, nameLength);
+            else if (isDirectory(fd, name, d->d_type))
+                arenaAppend(&subdirs, name, nameLength + 1);
+        }
+    }
+
+    close(fd);
+    memFree(m.ops);
+
+    /* deeper components read into the same buffer, so they run once this directory is done */
+    for (at = 0; at < subdirs.used; at += strlen(subdirs.data + at) + 1) {
+        size_t nameLength = strlen(subdirs.data + at);
+
+        if (length + nameLength + 1 >= PATH_MAX)
+            continue;
+        memcpy(path + length, subdirs.data + at, nameLength);
+        path[length + nameLength] = '/';
+        path[length + nameLength + 1] = 0;
+        walkPattern(w, path, length + nameLength + 1, rest);
+    }
+
+    path[length] = 0;
+    arenaFree(&subdirs);
+}
+
+/* path holds what the pattern matched so far (length bytes), pattern is the part still to match */
+static void walkPattern(walk *w, char *path, size_t length, const char *pattern) {
+    struct stat st;
+
+    /* literal components are copied as typed, a directory is only read for a wildcard component */
+    while (1) {
+        const char *slash = strchr(pattern, '/');
+        size_t componentLength = slash ? (size_t) (slash - pattern) : strlen(pattern);
+
+        if (isWild(pattern, componentLength)) {
+            readComponent(w, path, length, pattern, componentLength, slash ? slash + 1 : NULL);
+            return;
+        }
+
+        if (length + componentLength + 1 >= PATH_MAX)
+            return;
+        memcpy(path + length, pattern, componentLength + (slash != NULL));
+        length += componentLength + (slash != NULL);
+        path[length] = 0;
+
+        if (slash == NULL) {
+            /* literals after the last wildcard: a match when that path exists */
+            if (lstat(path, &st) == 0)
+                emit(w, path, length, "", 0);
+            return;
+        }
+        pattern = slash + 1;
+    }
+}
+
+size_t wildcardExpand(const char *pattern, arena *a, wildcardMatches *m) {
+    char path[PATH_MAX];
+    size_t first = m->count, count, i;
+    walk w = {a, m, memAlloc(MEM_LINES, WILDCARD_DENTS_SIZE)};
+    const char **sorted;
+
+    path[0] = 0;
+    walkPattern(&w, path, 0, pattern);
+    memFree(w.dents);
+
+    /* the arena is complete, pointers into it hold during the sort */
+    count = m->count - first;
+    if (count > 1) {
+        sorted = memAlloc(MEM_LINES, count * sizeof(char *));
+        for (i = 0; i < count; i++)
+            sorted[i] = a->data + m->offsets[first + i];
+
+        sortStrings(sorted, count, 0);
+
+        for (i = 0; i < count; i++)
+            m->offsets[first + i] = sorted[i] - a->data;
+        memFree(sorted);
+    }
+    return count;
+}
+
+/* ----- Arguments ----- */
+static void expandStage(cmdLine *stage) {
+    wildcardMatches m = {NULL, 0, 0};
+    arena strings;
+    char **argv;
+    int i, matched = 0;
+    size_t j;
+
+    for (i = 0; i < stage->argCount && !hasWildcards(stage->arguments[i]); i++);
+    if (i == stage->argCount)
+        return;
+
+    /* every argument goes into the block, the stage frees one allocation however many matches there are */
+    arenaInit(&strings);
+    for (i = 0; i < stage->argCount; i++) {
+        const char *arg = stage->arguments[i];
+
+        if (hasWildcards(arg) && wildcardExpand(arg, &strings, &m) > 0)
+            matched = 1;
+        else
+            addOffset(&m, arenaAppend(&strings, arg, strlen(arg) + 1));
+    }
+
+    if (!matched || m.count > INT_MAX) {
+        arenaFree(&strings);
+        memFree(m.offsets);
+        return;
+    }
+
+    argv = memAlloc(MEM_PARSER, (m.count + 1) * sizeof(char *));
+    for (j = 0; j < m.count; j++)
+        argv[j] = strings.data + m.offsets[j];
+    argv[m.count] = NULL;
+
+    setCmdArguments(stage, argv, (int) m.count, strings.data, strings.used);
+    memFree(m.offsets);
+}
+
+void expandWildcards(cmdLine *command) {
+    for (; command != NULL; command = command->next)
+        expandStage(command);
+}
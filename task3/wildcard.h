@@ -0,0 +1,34 @@
+//
+// Pathname expansion of words holding *, ? or [...]. Each component of a pattern is compiled once: its literal
+// prefix and suffix are split off and compared with memcmp, only the middle runs through the matcher.
+// Directories are read with getdents64 in WILDCARD_DENTS_SIZE batches and the matches go straight into an
+// arena, then they are sorted with a three-way radix quicksort (byte order, like the C locale) rather than
+// qsort on strcmp. Names starting with '.' only match a component starting with '.', . and .. never do.
+//
+
+#ifndef LAB6_WILDCARD_H
+#define LAB6_WILDCARD_H
+
+#include "LineParser.h"
+#include "arena.h"
+
+#define WILDCARD_DENTS_SIZE (256 * 1024)
+
+/* offsets of matched paths in the arena they were appended to */
+typedef struct wildcardMatches {
+    size_t *offsets;
+    size_t count, capacity;
+} wildcardMatches;
+
+/* 1 when word holds a *, a ? or a [ closed by a ] */
+int hasWildcards(const char *word);
+
+/* Appends the paths matching pattern to a, NUL-terminated, and their offsets to m in sorted order */
+/* Returns how many were appended, 0 when nothing matches */
+size_t wildcardExpand(const char *pattern, arena *a, wildcardMatches *m);
+
+/* Replaces each argument of the chain that has wildcards with its matches, an argument matching */
+/* nothing stays as typed. The arguments of an expanded stage end up in one arena block it owns */
+void expandWildcards(cmdLine *command);
+
+#endif //LAB6_WILDCARD_H